@@ -0,0 +1,58 @@
+#! /bin/bash
+
+# Launches the stages of a pipeline DAG described in a file, one per line:
+#   <name> <cpu|-> <inputs|-> <command...>
+# `inputs` is a comma-separated list of the shared memory objects a stage reads; it is started
+# once they all exist, so list the stages in any order. `cpu` pins the stage with taskset, `-`
+# leaves it unpinned. The inputs are removed first, so a DAG can be rerun. See pipeline.dag.
+
+if [ "$#" -ne 1 ]; then
+    echo "Usage: $0 <dag_file>"
+    exit 1
+fi
+
+dag_file=$1
+mkdir -p logs
+
+# wait until the producer of `shm_name` has published it, producers initialize it under another
+# name first, see create_shm_object()
+wait_for_shm() {
+    local path=/dev/shm/${1#/}
+    while [ ! -e "$path" ]; do
+        sleep 0.01
+    done
+}
+
+run_stage() {
+    local name=$1 cpu=$2 inputs=$3
+    shift 3
+    if [ "$inputs" != "-" ]; then
+        for shm_name in ${inputs//,/ }; do
+            wait_for_shm $shm_name
+        done
+    fi
+    local pin=()
+    if [ "$cpu" != "-" ]; then
+        pin=(taskset -c "$cpu")
+    fi
+    (time "${pin[@]}" "$@") > logs/$name.log 2>&1
+    echo "$name exited with $?"
+}
+
+# remove the outputs of the last run
+while read -r name cpu inputs cmd; do
+    [[ -z "$name" || "$name" == \#* || "$inputs" == "-" ]] && continue
+    for shm_name in ${inputs//,/ }; do
+        rm -f "/dev/shm/${shm_name#/}"
+    done
+done < "$dag_file"
+
+# the command stays a list of words, so it is neither split again nor glob expanded
+while read -r -a fields; do
+    name=${fields[0]} cpu=${fields[1]} inputs=${fields[2]} cmd=("${fields[@]:3}")
+    [[ -z "$name" || "$name" == \#* ]] && continue
+    echo "starting $name (cpu: $cpu, inputs: $inputs): ${cmd[*]}"
+    run_stage "$name" "$cpu" "$inputs" "${cmd[@]}" &
+done < "$dag_file"
+
+wait
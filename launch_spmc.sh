@@ -1,7 +1,11 @@
 #! /bin/bash
 
-if [ "$#" -ne 4 ]; then
-    echo "Usage: $0 <shm_name> <size_gb> <sym_cnt> <num_consumers>"
+if [ "$#" -lt 4 ] || [ "$#" -gt 7 ]; then
+    echo "Usage: $0 <shm_name> <size_gb> <sym_cnt> <num_consumers> [store_mode] [prefetch_dist]" \
+         "[release_mb]"
+    echo "  store_mode: memcpy (default) | nt | bulk | nt_bulk"
+    echo "  prefetch_dist: # of items consumers prefetch ahead, 0 (default) disables it"
+    echo "  release_mb: consumers unmap what they have read every N MB, 0 (default) disables it"
     exit 1
 fi
 
@@ -9,13 +13,18 @@ shm_name=$1
 size_gb=$2
 sym_cnt=$3
 num_consumers=$4
+store_mode=${5:-memcpy}
+prefetch_dist=${6:-0}
+release_mb=${7:-0}
 
 mkdir -p logs
 
-(time ./producer $shm_name $size_gb $sym_cnt) > logs/producer.log 2>&1 &
+# with a segmented log, retain it until all consumers have attached
+(time ./producer $shm_name $size_gb $sym_cnt $store_mode - - $num_consumers) > logs/producer.log \
+    2>&1 &
 
 for i in $(seq 1 $num_consumers); do
-    (time ./consumer $shm_name res_$i.csv) > logs/consumer_$i.log 2>&1 &
+    (time ./consumer $shm_name res_$i.csv $prefetch_dist $release_mb) > logs/consumer_$i.log 2>&1 &
 done
 
 wait
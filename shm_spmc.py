@@ -0,0 +1,162 @@
+"""Reads a PShmBBufferLockFree buffer from Python through libshm_spmc.so (`make libshm_spmc.so`).
+
+Batches are numpy structured arrays viewing the shared memory directly, no copies and no JSON:
+
+    with Consumer("/kline") as consumer:
+        for klines in consumer.batches():
+            print(klines["close"].mean())
+
+A view is only valid until the consumer advances past it (the next iteration of batches()) or
+is closed, copy it (`klines.copy()`) to keep it longer.
+"""
+import ctypes
+import os
+import sys
+import time
+
+import numpy as np
+
+CONSUME_SUCCESS, CONSUME_AGAIN, CONSUME_FINISHED = 1, 0, -1
+
+# struct KLineData in src/lock_free_test/data.h
+KLINE_DTYPE = np.dtype([
+    ("sym_id", "<u4"),
+    ("time", "<i4"),
+    ("volume", "<u4"),
+    ("num_trades", "<u4"),
+    ("open", "<i4"),
+    ("close", "<i4"),
+    ("high", "<i4"),
+    ("low", "<i4"),
+])
+
+ABI_VERSION = 2
+
+
+def _load_lib(path=None):
+    path = path or os.environ.get("SHM_SPMC_LIB") or os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), "libshm_spmc.so")
+    lib = ctypes.CDLL(path, use_errno=True)
+    if lib.shm_spmc_abi_version() != ABI_VERSION:
+        raise RuntimeError(f"{path}: ABI version {lib.shm_spmc_abi_version()}, "
+                           f"expected {ABI_VERSION}")
+    lib.shm_spmc_attach.restype = ctypes.c_void_p
+    lib.shm_spmc_attach.argtypes = [ctypes.c_char_p, ctypes.c_size_t]
+    lib.shm_spmc_detach.argtypes = [ctypes.c_void_p]
+    lib.shm_spmc_peek.restype = ctypes.c_int
+    lib.shm_spmc_peek.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p),
+                                  ctypes.POINTER(ctypes.c_uint64), ctypes.c_uint64]
+    for name in ("advance", "seek"):
+        getattr(lib, "shm_spmc_" + name).argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    lib.shm_spmc_advance.restype = ctypes.c_int
+    for name in ("position", "size", "capacity"):
+        getattr(lib, "shm_spmc_" + name).restype = ctypes.c_uint64
+        getattr(lib, "shm_spmc_" + name).argtypes = [ctypes.c_void_p]
+    return lib
+
+
+class Consumer:
+    """A consumer of the buffer `shm_name`, whose items are laid out as `dtype`."""
+
+    def __init__(self, shm_name, dtype=KLINE_DTYPE, lib_path=None):
+        self._lib = _load_lib(lib_path)
+        self.dtype = np.dtype(dtype)
+        self._handle = self._lib.shm_spmc_attach(shm_name.encode(), self.dtype.itemsize)
+        if not self._handle:
+            errno = ctypes.get_errno()
+            raise OSError(errno, f"{shm_name}: {os.strerror(errno)}"
+                          f" (is it a lock-free buffer of {self.dtype.itemsize}-byte items?)")
+        self._items = ctypes.c_void_p()
+        self._n = ctypes.c_uint64()
+
+    def peek(self, max_n=1 << 16):
+        """Returns (rc, view) with up to `max_n` published items at the head, the view is
+        empty unless rc is CONSUME_SUCCESS."""
+        rc = self._lib.shm_spmc_peek(self._handle, ctypes.byref(self._items),
+                                     ctypes.byref(self._n), max_n)
+        if rc != CONSUME_SUCCESS:
+            return rc, np.empty(0, self.dtype)
+        n = self._n.value
+        buf = (ctypes.c_char * (n * self.dtype.itemsize)).from_address(self._items.value)
+        view = np.frombuffer(buf, self.dtype, n)
+        view.flags.writeable = False  # mapped read-only
+        return rc, view
+
+    def advance(self, n):
+        """Moves the head past `n` items of the last peek(), raises ValueError if it returned
+        fewer."""
+        if self._lib.shm_spmc_advance(self._handle, n) != 0:
+            raise ValueError(f"can't advance past {n} items, more than the last peek() returned")
+
+    def batches(self, max_n=1 << 16, poll_interval=0.001):
+        """Yields views of the items as they are published until the producer finishes,
+        advancing past each one when the next is requested."""
+        while True:
+            rc, view = self.peek(max_n)
+            if rc == CONSUME_FINISHED:
+                return
+            if rc == CONSUME_AGAIN:
+                time.sleep(poll_interval)
+                continue
+            yield view
+            self.advance(len(view))
+
+    def seek(self, index):
+        self._lib.shm_spmc_seek(self._handle, index)
+
+    @property
+    def position(self):
+        return self._lib.shm_spmc_position(self._handle)
+
+    @property
+    def size(self):
+        return self._lib.shm_spmc_size(self._handle)
+
+    @property
+    def capacity(self):
+        return self._lib.shm_spmc_capacity(self._handle)
+
+    def close(self):
+        if self._handle:
+            self._lib.shm_spmc_detach(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+
+# sums the volume and # of trades of every symbol, like the first columns of `consumer`'s csv
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(f"Usage: {sys.argv[0]} <shm_name> [out_file]")
+        sys.exit(-1)
+
+    count = np.zeros(0, np.uint64)
+    vol = np.zeros(0, np.uint64)
+    num_trades = np.zeros(0, np.uint64)
+    start = time.perf_counter()
+    with Consumer(sys.argv[1]) as consumer:
+        for klines in consumer.batches():
+            max_id = int(klines["sym_id"].max()) + 1
+            if max_id > len(vol):
+                count, vol, num_trades = (np.pad(a, (0, max_id - len(a)))
+                                          for a in (count, vol, num_trades))
+            count += np.bincount(klines["sym_id"], minlength=len(vol)).astype(np.uint64)
+            vol += np.bincount(klines["sym_id"], klines["volume"], len(vol)).astype(np.uint64)
+            num_trades += np.bincount(klines["sym_id"], klines["num_trades"],
+                                      len(vol)).astype(np.uint64)
+        total = consumer.position
+    secs = time.perf_counter() - start
+    print(f"{total} klines in {secs:.3f}s, {total / secs / 1e6:.1f}M klines/s")
+
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "w") as f:
+            f.write("sym_id,vol,num_trades\n")
+            for sym_id in np.nonzero(count)[0]:
+                f.write(f"{sym_id},{vol[sym_id]},{num_trades[sym_id]}\n")
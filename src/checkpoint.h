@@ -0,0 +1,245 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace shm_spmc {
+
+struct CheckpointHeader {
+    uint64_t magic;
+    uint64_t seq;       // 1, 2, ... the larger valid one wins
+    idx_t index;        // the state covers the log records [0, index)
+    uint64_t size;      // # of payload bytes following the header
+    uint64_t checksum;  // of the payload
+};
+
+// Periodic snapshots of a consumer's state plus the log index they cover, so a restarted
+// consumer restores the state and seek()s the log there instead of replaying it from 0.
+//
+// Snapshots are double-buffered in `<path>.0` and `<path>.1`: save() always overwrites the
+// older one and the header carries a checksum, so a crash during save() leaves the previous
+// snapshot intact and load() picks the newest one that is complete.
+//
+// save_async() hands the snapshot to a writer thread instead, so the caller only pays for
+// building the payload, not for the write and fsync.
+class Checkpoint {
+public:
+    explicit Checkpoint(const std::string &path) : path_(path) {
+        // continue the sequence of a previous run, so the next save() keeps its latest snapshot
+        CheckpointHeader header;
+        std::vector<char> payload;
+        for (int slot = 0; slot < 2; slot++) {
+            if (read_slot(slot, header, payload) && header.seq > seq_)
+                seq_ = header.seq;
+        }
+    }
+
+    // writes the snapshot save_async() may still have queued
+    ~Checkpoint() {
+        if (writer_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_one();
+            writer_.join();
+        }
+    }
+
+    // writes a snapshot of `payload` covering the records [0, index), durably
+    // don't mix with save_async()
+    void save(idx_t index, const std::vector<char> &payload) {
+        CheckpointHeader header{kMagic, ++seq_, index, payload.size(),
+                                checksum(payload.data(), payload.size())};
+        std::string slot_path = path_ + "." + std::to_string(header.seq % 2);
+        int fd = open(slot_path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0600);
+        if (fd == -1)
+            handle_error("open");
+        write_all(fd, &header, sizeof header);
+        write_all(fd, payload.data(), payload.size());
+        if (fdatasync(fd) == -1)
+            handle_error("fdatasync");
+        close(fd);
+        sync_dir();
+    }
+
+    // Like save(), but in the background: takes `payload` and leaves a previously saved buffer
+    // (or an empty one) in its place, for reuse. If the writer is still busy, the snapshot
+    // replaces the one waiting, if any, since only the newest matters.
+    void save_async(idx_t index, std::vector<char> &payload) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!writer_.joinable())
+                writer_ = std::thread(&Checkpoint::write_loop, this);
+            pending_.swap(payload);
+            pending_index_ = index;
+            has_pending_ = true;
+        }
+        payload.clear();
+        cv_.notify_one();
+    }
+
+    // reads the newest complete snapshot, returns false if there is none
+    bool load(idx_t &index, std::vector<char> &payload) const {
+        CheckpointHeader header, best{};
+        std::vector<char> data;
+        for (int slot = 0; slot < 2; slot++) {
+            if (read_slot(slot, header, data) && header.seq > best.seq) {
+                best = header;
+                payload.swap(data);
+            }
+        }
+        index = best.index;
+        return best.seq != 0;
+    }
+
+    // 64-bit multiplicative hash, 8 bytes at a time
+    static uint64_t checksum(const char *data, size_t n) {
+        uint64_t h = 0x9e3779b97f4a7c15 ^ n;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            memcpy(&w, data + i, 8);
+            h = (h ^ w) * 0xff51afd7ed558ccd;
+            h ^= h >> 32;
+        }
+        for (; i < n; i++)
+            h = (h ^ (uint8_t)data[i]) * 0x100000001b3;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t kMagic = 0x31544b50434d5053;  // "SPMCPKT1"
+
+    void write_loop() {
+        std::vector<char> payload;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this] { return has_pending_ || stop_; });
+            if (!has_pending_)
+                return;
+            payload.swap(pending_);
+            idx_t index = pending_index_;
+            has_pending_ = false;
+            lock.unlock();
+            save(index, payload);
+            lock.lock();
+        }
+    }
+
+    // makes the slot files' directory entries durable, they may have just been created
+    void sync_dir() const {
+        size_t slash = path_.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : path_.substr(0, slash + 1);
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd == -1)
+            handle_error("open");
+        if (fsync(fd) == -1)
+            handle_error("fsync");
+        close(fd);
+    }
+
+    static void write_all(int fd, const void *data, size_t n) {
+        const char *p = static_cast<const char *>(data);
+        while (n > 0) {
+            ssize_t nbytes = write(fd, p, n);
+            if (nbytes == -1)
+                handle_error("write");
+            p += nbytes;
+            n -= nbytes;
+        }
+    }
+
+    // returns false if the slot is missing, truncated or corrupt
+    bool read_slot(int slot, CheckpointHeader &header, std::vector<char> &payload) const {
+        std::string slot_path = path_ + "." + std::to_string(slot);
+        int fd = open(slot_path.c_str(), O_RDONLY);
+        if (fd == -1)
+            return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof header &&
+                  ::read(fd, &header, sizeof header) == sizeof header && header.magic == kMagic &&
+                  header.size == st.st_size - sizeof header;
+        if (ok) {
+            payload.resize(header.size);
+            size_t done = 0;
+            ssize_t nbytes = 0;
+            while (done < header.size &&
+                   (nbytes = ::read(fd, payload.data() + done, header.size - done)) > 0)
+                done += nbytes;
+            ok = done == header.size && checksum(payload.data(), payload.size()) == header.checksum;
+        }
+        close(fd);
+        return ok;
+    }
+
+    const std::string path_;
+    uint64_t seq_ = 0;
+
+    // save_async() -> writer thread
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<char> pending_;
+    idx_t pending_index_ = 0;
+    bool has_pending_ = false;
+    bool stop_ = false;
+};
+
+// appends trivially copyable values to a snapshot payload
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(std::vector<char> &payload) : payload_(payload) {}
+
+    template <typename T>
+    void put(const T *items, size_t n) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const char *p = reinterpret_cast<const char *>(items);
+        payload_.insert(payload_.end(), p, p + n * sizeof(T));
+    }
+
+    template <typename T>
+    void put(const T &item) { put(&item, 1); }
+
+private:
+    std::vector<char> &payload_;
+};
+
+// reads back what a CheckpointWriter wrote, get() returns false past the end
+class CheckpointReader {
+public:
+    explicit CheckpointReader(const std::vector<char> &payload) : payload_(payload) {}
+
+    template <typename T>
+    bool get(T *items, size_t n) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (n > (payload_.size() - pos_) / sizeof(T))
+            return false;
+        memcpy(items, payload_.data() + pos_, n * sizeof(T));
+        pos_ += n * sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool get(T &item) { return get(&item, 1); }
+
+    size_t remaining() const { return payload_.size() - pos_; }
+
+private:
+    const std::vector<char> &payload_;
+    size_t pos_ = 0;
+};
+
+}  // namespace shm_spmc
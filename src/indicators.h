@@ -0,0 +1,566 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Technical indicators over the whole symbol universe, one timestep at a time.
+//
+// Every kernel takes columns with one value per symbol and updates the running state of all
+// symbols in one pass, so the symbols are the vector lanes (4 doubles with AVX2, 2 with NEON)
+// and each timestep is O(1) per symbol. The kernels run the same operations in the same order
+// as the scalar reference, which `simd = false` selects, so both give the same results.
+namespace shm_spmc {
+
+namespace detail {
+
+// Compilers may fuse a * b + c into one FMA, which rounds once instead of twice. GCC does so by
+// default (-ffp-contract=fast) wherever the target has FMA, e.g. on any aarch64 and on x86 with
+// -march=native, and not necessarily at the same places in the scalar and the SIMD kernels, so
+// the kernels are compiled without it.
+#if defined(__clang__)
+#pragma float_control(push)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+inline bool has_simd() {
+#if defined(__x86_64__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+#elif defined(__aarch64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// The *_simd() kernels process the symbols [0, i) and return i, the scalar ones the rest.
+
+inline void sma_scalar(double *sum, const double *x_new, const double *x_old, double inv_len,
+                       double *out, size_t i, size_t n) {
+    for (; i < n; i++) {
+        sum[i] += x_new[i] - x_old[i];
+        out[i] = sum[i] * inv_len;
+    }
+}
+
+inline void ema_scalar(double *ema, const double *x, double alpha, size_t i, size_t n) {
+    for (; i < n; i++)
+        ema[i] += alpha * (x[i] - ema[i]);
+}
+
+inline void vwap_scalar(double *pv, double *vol, const double *high, const double *low,
+                        const double *close, const double *volume, double *out, size_t i,
+                        size_t n) {
+    for (; i < n; i++) {
+        double typical = (high[i] + low[i] + close[i]) / 3.0;
+        pv[i] += typical * volume[i];
+        vol[i] += volume[i];
+        out[i] = vol[i] > 0 ? pv[i] / vol[i] : typical;
+    }
+}
+
+inline void rsi_scalar(double *avg_gain, double *avg_loss, const double *prev_close,
+                       const double *close, double alpha, double *out, size_t i, size_t n) {
+    for (; i < n; i++) {
+        double gain = std::max(close[i] - prev_close[i], 0.0);
+        double loss = std::max(prev_close[i] - close[i], 0.0);
+        avg_gain[i] += alpha * (gain - avg_gain[i]);
+        avg_loss[i] += alpha * (loss - avg_loss[i]);
+        double sum = avg_gain[i] + avg_loss[i];
+        out[i] = sum > 0 ? 100.0 * avg_gain[i] / sum : 50.0;
+    }
+}
+
+inline void atr_scalar(double *atr, const double *prev_close, const double *high,
+                       const double *low, double alpha, size_t i, size_t n) {
+    for (; i < n; i++) {
+        double tr = std::max(high[i] - low[i], std::max(std::fabs(high[i] - prev_close[i]),
+                                                        std::fabs(low[i] - prev_close[i])));
+        atr[i] += alpha * (tr - atr[i]);
+    }
+}
+
+inline void bollinger_scalar(double *sum, double *sum_sq, const double *x_new,
+                             const double *x_old, double inv_len, double k, double *mid,
+                             double *upper, double *lower, size_t i, size_t n) {
+    for (; i < n; i++) {
+        sum[i] += x_new[i] - x_old[i];
+        sum_sq[i] += x_new[i] * x_new[i] - x_old[i] * x_old[i];
+        double mean = sum[i] * inv_len;
+        double sd = std::sqrt(std::max(sum_sq[i] * inv_len - mean * mean, 0.0));
+        mid[i] = mean;
+        upper[i] = mean + k * sd;
+        lower[i] = mean - k * sd;
+    }
+}
+
+#if defined(__x86_64__)
+#define SHM_SPMC_SIMD_KERNEL __attribute__((target("avx2"))) inline
+
+SHM_SPMC_SIMD_KERNEL size_t sma_simd(double *sum, const double *x_new, const double *x_old,
+                                     double inv_len, double *out, size_t n) {
+    const __m256d inv = _mm256_set1_pd(inv_len);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(&x_new[i]), _mm256_loadu_pd(&x_old[i]));
+        __m256d s = _mm256_add_pd(_mm256_loadu_pd(&sum[i]), d);
+        _mm256_storeu_pd(&sum[i], s);
+        _mm256_storeu_pd(&out[i], _mm256_mul_pd(s, inv));
+    }
+    return i;
+}
+
+SHM_SPMC_SIMD_KERNEL size_t ema_simd(double *ema, const double *x, double alpha, size_t n) {
+    const __m256d a = _mm256_set1_pd(alpha);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d e = _mm256_loadu_pd(&ema[i]);
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(&x[i]), e);
+        _mm256_storeu_pd(&ema[i], _mm256_add_pd(e, _mm256_mul_pd(a, d)));
+    }
+    return i;
+}
+
+SHM_SPMC_SIMD_KERNEL size_t vwap_simd(double *pv, double *vol, const double *high,
+                                      const double *low, const double *close,
+                                      const double *volume, double *out, size_t n) {
+    const __m256d three = _mm256_set1_pd(3.0);
+    const __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d typical = _mm256_add_pd(_mm256_loadu_pd(&high[i]), _mm256_loadu_pd(&low[i]));
+        typical = _mm256_div_pd(_mm256_add_pd(typical, _mm256_loadu_pd(&close[i])), three);
+        __m256d v = _mm256_loadu_pd(&volume[i]);
+        __m256d p = _mm256_add_pd(_mm256_loadu_pd(&pv[i]), _mm256_mul_pd(typical, v));
+        __m256d vs = _mm256_add_pd(_mm256_loadu_pd(&vol[i]), v);
+        _mm256_storeu_pd(&pv[i], p);
+        _mm256_storeu_pd(&vol[i], vs);
+        __m256d has_vol = _mm256_cmp_pd(vs, zero, _CMP_GT_OQ);
+        _mm256_storeu_pd(&out[i], _mm256_blendv_pd(typical, _mm256_div_pd(p, vs), has_vol));
+    }
+    return i;
+}
+
+SHM_SPMC_SIMD_KERNEL size_t rsi_simd(double *avg_gain, double *avg_loss,
+                                     const double *prev_close, const double *close, double alpha,
+                                     double *out, size_t n) {
+    const __m256d a = _mm256_set1_pd(alpha);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d hundred = _mm256_set1_pd(100.0);
+    const __m256d fifty = _mm256_set1_pd(50.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d c = _mm256_loadu_pd(&close[i]);
+        __m256d pc = _mm256_loadu_pd(&prev_close[i]);
+        __m256d gain = _mm256_max_pd(_mm256_sub_pd(c, pc), zero);
+        __m256d loss = _mm256_max_pd(_mm256_sub_pd(pc, c), zero);
+        __m256d ag = _mm256_loadu_pd(&avg_gain[i]);
+        __m256d al = _mm256_loadu_pd(&avg_loss[i]);
+        ag = _mm256_add_pd(ag, _mm256_mul_pd(a, _mm256_sub_pd(gain, ag)));
+        al = _mm256_add_pd(al, _mm256_mul_pd(a, _mm256_sub_pd(loss, al)));
+        _mm256_storeu_pd(&avg_gain[i], ag);
+        _mm256_storeu_pd(&avg_loss[i], al);
+        __m256d sum = _mm256_add_pd(ag, al);
+        __m256d rsi = _mm256_div_pd(_mm256_mul_pd(hundred, ag), sum);
+        __m256d has_change = _mm256_cmp_pd(sum, zero, _CMP_GT_OQ);
+        _mm256_storeu_pd(&out[i], _mm256_blendv_pd(fifty, rsi, has_change));
+    }
+    return i;
+}
+
+SHM_SPMC_SIMD_KERNEL size_t atr_simd(double *atr, const double *prev_close, const double *high,
+                                     const double *low, double alpha, size_t n) {
+    const __m256d a = _mm256_set1_pd(alpha);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d h = _mm256_loadu_pd(&high[i]);
+        __m256d l = _mm256_loadu_pd(&low[i]);
+        __m256d pc = _mm256_loadu_pd(&prev_close[i]);
+        __m256d hc = _mm256_andnot_pd(sign, _mm256_sub_pd(h, pc));
+        __m256d lc = _mm256_andnot_pd(sign, _mm256_sub_pd(l, pc));
+        __m256d tr = _mm256_max_pd(_mm256_sub_pd(h, l), _mm256_max_pd(hc, lc));
+        __m256d r = _mm256_loadu_pd(&atr[i]);
+        _mm256_storeu_pd(&atr[i], _mm256_add_pd(r, _mm256_mul_pd(a, _mm256_sub_pd(tr, r))));
+    }
+    return i;
+}
+
+SHM_SPMC_SIMD_KERNEL size_t bollinger_simd(double *sum, double *sum_sq, const double *x_new,
+                                           const double *x_old, double inv_len, double k,
+                                           double *mid, double *upper, double *lower, size_t n) {
+    const __m256d inv = _mm256_set1_pd(inv_len);
+    const __m256d kk = _mm256_set1_pd(k);
+    const __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d xn = _mm256_loadu_pd(&x_new[i]);
+        __m256d xo = _mm256_loadu_pd(&x_old[i]);
+        __m256d s = _mm256_add_pd(_mm256_loadu_pd(&sum[i]), _mm256_sub_pd(xn, xo));
+        __m256d sq = _mm256_sub_pd(_mm256_mul_pd(xn, xn), _mm256_mul_pd(xo, xo));
+        sq = _mm256_add_pd(_mm256_loadu_pd(&sum_sq[i]), sq);
+        _mm256_storeu_pd(&sum[i], s);
+        _mm256_storeu_pd(&sum_sq[i], sq);
+        __m256d mean = _mm256_mul_pd(s, inv);
+        __m256d var = _mm256_sub_pd(_mm256_mul_pd(sq, inv), _mm256_mul_pd(mean, mean));
+        __m256d band = _mm256_mul_pd(kk, _mm256_sqrt_pd(_mm256_max_pd(var, zero)));
+        _mm256_storeu_pd(&mid[i], mean);
+        _mm256_storeu_pd(&upper[i], _mm256_add_pd(mean, band));
+        _mm256_storeu_pd(&lower[i], _mm256_sub_pd(mean, band));
+    }
+    return i;
+}
+
+#undef SHM_SPMC_SIMD_KERNEL
+#elif defined(__aarch64__)
+inline size_t sma_simd(double *sum, const double *x_new, const double *x_old, double inv_len,
+                       double *out, size_t n) {
+    const float64x2_t inv = vdupq_n_f64(inv_len);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t d = vsubq_f64(vld1q_f64(&x_new[i]), vld1q_f64(&x_old[i]));
+        float64x2_t s = vaddq_f64(vld1q_f64(&sum[i]), d);
+        vst1q_f64(&sum[i], s);
+        vst1q_f64(&out[i], vmulq_f64(s, inv));
+    }
+    return i;
+}
+
+inline size_t ema_simd(double *ema, const double *x, double alpha, size_t n) {
+    const float64x2_t a = vdupq_n_f64(alpha);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t e = vld1q_f64(&ema[i]);
+        float64x2_t d = vsubq_f64(vld1q_f64(&x[i]), e);
+        vst1q_f64(&ema[i], vaddq_f64(e, vmulq_f64(a, d)));
+    }
+    return i;
+}
+
+inline size_t vwap_simd(double *pv, double *vol, const double *high, const double *low,
+                        const double *close, const double *volume, double *out, size_t n) {
+    const float64x2_t three = vdupq_n_f64(3.0);
+    const float64x2_t zero = vdupq_n_f64(0.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t typical = vaddq_f64(vld1q_f64(&high[i]), vld1q_f64(&low[i]));
+        typical = vdivq_f64(vaddq_f64(typical, vld1q_f64(&close[i])), three);
+        float64x2_t v = vld1q_f64(&volume[i]);
+        float64x2_t p = vaddq_f64(vld1q_f64(&pv[i]), vmulq_f64(typical, v));
+        float64x2_t vs = vaddq_f64(vld1q_f64(&vol[i]), v);
+        vst1q_f64(&pv[i], p);
+        vst1q_f64(&vol[i], vs);
+        vst1q_f64(&out[i], vbslq_f64(vcgtq_f64(vs, zero), vdivq_f64(p, vs), typical));
+    }
+    return i;
+}
+
+inline size_t rsi_simd(double *avg_gain, double *avg_loss, const double *prev_close,
+                       const double *close, double alpha, double *out, size_t n) {
+    const float64x2_t a = vdupq_n_f64(alpha);
+    const float64x2_t zero = vdupq_n_f64(0.0);
+    const float64x2_t hundred = vdupq_n_f64(100.0);
+    const float64x2_t fifty = vdupq_n_f64(50.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t c = vld1q_f64(&close[i]);
+        float64x2_t pc = vld1q_f64(&prev_close[i]);
+        float64x2_t gain = vmaxq_f64(vsubq_f64(c, pc), zero);
+        float64x2_t loss = vmaxq_f64(vsubq_f64(pc, c), zero);
+        float64x2_t ag = vld1q_f64(&avg_gain[i]);
+        float64x2_t al = vld1q_f64(&avg_loss[i]);
+        ag = vaddq_f64(ag, vmulq_f64(a, vsubq_f64(gain, ag)));
+        al = vaddq_f64(al, vmulq_f64(a, vsubq_f64(loss, al)));
+        vst1q_f64(&avg_gain[i], ag);
+        vst1q_f64(&avg_loss[i], al);
+        float64x2_t sum = vaddq_f64(ag, al);
+        float64x2_t rsi = vdivq_f64(vmulq_f64(hundred, ag), sum);
+        vst1q_f64(&out[i], vbslq_f64(vcgtq_f64(sum, zero), rsi, fifty));
+    }
+    return i;
+}
+
+inline size_t atr_simd(double *atr, const double *prev_close, const double *high,
+                       const double *low, double alpha, size_t n) {
+    const float64x2_t a = vdupq_n_f64(alpha);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t h = vld1q_f64(&high[i]);
+        float64x2_t l = vld1q_f64(&low[i]);
+        float64x2_t pc = vld1q_f64(&prev_close[i]);
+        float64x2_t hc = vabsq_f64(vsubq_f64(h, pc));
+        float64x2_t lc = vabsq_f64(vsubq_f64(l, pc));
+        float64x2_t tr = vmaxq_f64(vsubq_f64(h, l), vmaxq_f64(hc, lc));
+        float64x2_t r = vld1q_f64(&atr[i]);
+        vst1q_f64(&atr[i], vaddq_f64(r, vmulq_f64(a, vsubq_f64(tr, r))));
+    }
+    return i;
+}
+
+inline size_t bollinger_simd(double *sum, double *sum_sq, const double *x_new,
+                             const double *x_old, double inv_len, double k, double *mid,
+                             double *upper, double *lower, size_t n) {
+    const float64x2_t inv = vdupq_n_f64(inv_len);
+    const float64x2_t kk = vdupq_n_f64(k);
+    const float64x2_t zero = vdupq_n_f64(0.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t xn = vld1q_f64(&x_new[i]);
+        float64x2_t xo = vld1q_f64(&x_old[i]);
+        float64x2_t s = vaddq_f64(vld1q_f64(&sum[i]), vsubq_f64(xn, xo));
+        float64x2_t sq = vsubq_f64(vmulq_f64(xn, xn), vmulq_f64(xo, xo));
+        sq = vaddq_f64(vld1q_f64(&sum_sq[i]), sq);
+        vst1q_f64(&sum[i], s);
+        vst1q_f64(&sum_sq[i], sq);
+        float64x2_t mean = vmulq_f64(s, inv);
+        float64x2_t var = vsubq_f64(vmulq_f64(sq, inv), vmulq_f64(mean, mean));
+        float64x2_t band = vmulq_f64(kk, vsqrtq_f64(vmaxq_f64(var, zero)));
+        vst1q_f64(&mid[i], mean);
+        vst1q_f64(&upper[i], vaddq_f64(mean, band));
+        vst1q_f64(&lower[i], vsubq_f64(mean, band));
+    }
+    return i;
+}
+#endif
+
+#if defined(__clang__)
+#pragma float_control(pop)
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+}  // namespace detail
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define SHM_SPMC_SIMD_OR_ZERO(simd, call) ((simd) && detail::has_simd() ? detail::call : 0)
+#else
+#define SHM_SPMC_SIMD_OR_ZERO(simd, call) 0
+#endif
+
+// Simple moving average: `sum` holds the sum of the window, `x_old` the values leaving it
+// (zeros while it fills up) and `inv_len` is 1 / the # of values in it.
+inline void sma_update(double *sum, const double *x_new, const double *x_old, double inv_len,
+                       double *out, size_t n, bool simd = true) {
+    size_t i = SHM_SPMC_SIMD_OR_ZERO(simd, sma_simd(sum, x_new, x_old, inv_len, out, n));
+    detail::sma_scalar(sum, x_new, x_old, inv_len, out, i, n);
+}
+
+// Exponential moving average, updated in place: ema += alpha * (x - ema).
+inline void ema_update(double *ema, const double *x, double alpha, size_t n, bool simd = true) {
+    size_t i = SHM_SPMC_SIMD_OR_ZERO(simd, ema_simd(ema, x, alpha, n));
+    detail::ema_scalar(ema, x, alpha, i, n);
+}
+
+// Volume-weighted average of the typical price (high + low + close) / 3, since `pv` and `vol`
+// (the sums of price * volume and volume) were last zeroed, e.g. at the start of a session.
+inline void vwap_update(double *pv, double *vol, const double *high, const double *low,
+                        const double *close, const double *volume, double *out, size_t n,
+                        bool simd = true) {
+    size_t i =
+        SHM_SPMC_SIMD_OR_ZERO(simd, vwap_simd(pv, vol, high, low, close, volume, out, n));
+    detail::vwap_scalar(pv, vol, high, low, close, volume, out, i, n);
+}
+
+// Relative strength index with Wilder's smoothing (alpha = 1 / length) of the average gain and
+// loss, 50 while there has been no change.
+inline void rsi_update(double *avg_gain, double *avg_loss, const double *prev_close,
+                       const double *close, double alpha, double *out, size_t n,
+                       bool simd = true) {
+    size_t i = SHM_SPMC_SIMD_OR_ZERO(
+        simd, rsi_simd(avg_gain, avg_loss, prev_close, close, alpha, out, n));
+    detail::rsi_scalar(avg_gain, avg_loss, prev_close, close, alpha, out, i, n);
+}
+
+// Average true range with Wilder's smoothing, updated in place.
+inline void atr_update(double *atr, const double *prev_close, const double *high,
+                       const double *low, double alpha, size_t n, bool simd = true) {
+    size_t i = SHM_SPMC_SIMD_OR_ZERO(simd, atr_simd(atr, prev_close, high, low, alpha, n));
+    detail::atr_scalar(atr, prev_close, high, low, alpha, i, n);
+}
+
+// Bollinger bands: the moving average +/- k standard deviations of the window, from running
+// sums of the values and their squares (see sma_update()).
+inline void bollinger_update(double *sum, double *sum_sq, const double *x_new,
+                             const double *x_old, double inv_len, double k, double *mid,
+                             double *upper, double *lower, size_t n, bool simd = true) {
+    size_t i = SHM_SPMC_SIMD_OR_ZERO(
+        simd, bollinger_simd(sum, sum_sq, x_new, x_old, inv_len, k, mid, upper, lower, n));
+    detail::bollinger_scalar(sum, sum_sq, x_new, x_old, inv_len, k, mid, upper, lower, i, n);
+}
+
+#undef SHM_SPMC_SIMD_OR_ZERO
+
+struct IndicatorConfig {
+    size_t sma_len = 20;
+    size_t ema_len = 20;
+    size_t rsi_len = 14;
+    size_t atr_len = 14;
+    size_t bb_len = 20;
+    double bb_k = 2.0;
+};
+
+// Keeps the history and indicator state of `num_symbols` symbols as columns (struct of arrays),
+// and updates all indicators of all symbols once per timestep.
+//
+// Fill the columns of the next timestep, one value per symbol, then call update(). The close
+// column is a row of a ring of the last max(sma_len, bb_len) closes, which the moving averages
+// need to drop the oldest value. While a window fills up the averages are over the values so
+// far, and Wilder's smoothing starts from the simple average, as usual. The running sums of the
+// windows are recomputed from the ring now and then so rounding errors don't accumulate.
+class IndicatorEngine {
+public:
+    enum Field { CLOSE, HIGH, LOW, VOLUME };
+
+    explicit IndicatorEngine(size_t num_symbols, const IndicatorConfig &config = {},
+                             bool simd = true)
+        : n_(num_symbols),
+          config_(config),
+          simd_(simd),
+          window_(std::max(config.sma_len, config.bb_len) + 1),
+          closes_(window_ * n_),
+          zeros_(n_),
+          high_(n_),
+          low_(n_),
+          volume_(n_),
+          prev_close_(n_),
+          sma_sum_(n_),
+          sma_(n_),
+          ema_(n_),
+          pv_(n_),
+          vol_sum_(n_),
+          vwap_(n_),
+          avg_gain_(n_),
+          avg_loss_(n_),
+          rsi_(n_),
+          atr_(n_),
+          bb_sum_(n_),
+          bb_sum_sq_(n_),
+          bb_mid_(n_),
+          bb_upper_(n_),
+          bb_lower_(n_) {}
+
+    // the column of the next timestep to fill in
+    double *column(Field field) {
+        switch (field) {
+        case CLOSE:
+            return close_row(steps_);
+        case HIGH:
+            return high_.data();
+        case LOW:
+            return low_.data();
+        default:
+            return volume_.data();
+        }
+    }
+
+    void update() {
+        const size_t t = steps_;
+        const double *close = close_row(t);
+        if (t == 0) {
+            std::copy(close, close + n_, prev_close_.begin());
+            std::copy(close, close + n_, ema_.begin());
+        }
+
+        sma_update(sma_sum_.data(), close, leaving(t, config_.sma_len),
+                   1.0 / filled(t, config_.sma_len), sma_.data(), n_, simd_);
+        ema_update(ema_.data(), close, 2.0 / (config_.ema_len + 1), n_, simd_);
+        vwap_update(pv_.data(), vol_sum_.data(), high_.data(), low_.data(), close,
+                    volume_.data(), vwap_.data(), n_, simd_);
+        // the first change is at t = 1
+        rsi_update(avg_gain_.data(), avg_loss_.data(), prev_close_.data(), close,
+                   1.0 / std::max<size_t>(1, std::min(t, config_.rsi_len)), rsi_.data(), n_,
+                   simd_);
+        atr_update(atr_.data(), prev_close_.data(), high_.data(), low_.data(),
+                   1.0 / filled(t, config_.atr_len), n_, simd_);
+        bollinger_update(bb_sum_.data(), bb_sum_sq_.data(), close, leaving(t, config_.bb_len),
+                         1.0 / filled(t, config_.bb_len), config_.bb_k, bb_mid_.data(),
+                         bb_upper_.data(), bb_lower_.data(), n_, simd_);
+        std::copy(close, close + n_, prev_close_.begin());
+
+        steps_++;
+        if (steps_ % kResyncSteps == 0)
+            resync();
+    }
+
+    // restarts the VWAP, e.g. at the start of a session
+    void reset_vwap() {
+        std::fill(pv_.begin(), pv_.end(), 0.0);
+        std::fill(vol_sum_.begin(), vol_sum_.end(), 0.0);
+    }
+
+    size_t num_symbols() const { return n_; }
+    size_t timesteps() const { return steps_; }
+
+    const double *sma() const { return sma_.data(); }
+    const double *ema() const { return ema_.data(); }
+    const double *vwap() const { return vwap_.data(); }
+    const double *rsi() const { return rsi_.data(); }
+    const double *atr() const { return atr_.data(); }
+    const double *bb_mid() const { return bb_mid_.data(); }
+    const double *bb_upper() const { return bb_upper_.data(); }
+    const double *bb_lower() const { return bb_lower_.data(); }
+
+private:
+    static constexpr size_t kResyncSteps = 4096;
+
+    double *close_row(size_t t) { return &closes_[t % window_ * n_]; }
+
+    // the closes leaving a window of `len` at timestep `t`, zeros while it fills up
+    const double *leaving(size_t t, size_t len) {
+        return t >= len ? close_row(t - len) : zeros_.data();
+    }
+
+    static size_t filled(size_t t, size_t len) { return std::min(t + 1, len); }
+
+    // recomputes the running sums of the windows ending at the last timestep
+    void resync() {
+        const size_t t = steps_ - 1;
+        std::fill(sma_sum_.begin(), sma_sum_.end(), 0.0);
+        std::fill(bb_sum_.begin(), bb_sum_.end(), 0.0);
+        std::fill(bb_sum_sq_.begin(), bb_sum_sq_.end(), 0.0);
+        // oldest first, the same order they were added in
+        for (size_t j = std::max(config_.sma_len, config_.bb_len); j-- > 0;) {
+            if (j > t)
+                continue;
+            const double *row = close_row(t - j);
+            for (size_t i = 0; i < n_; i++) {
+                if (j < config_.sma_len)
+                    sma_sum_[i] += row[i];
+                if (j < config_.bb_len) {
+                    bb_sum_[i] += row[i];
+                    bb_sum_sq_[i] += row[i] * row[i];
+                }
+            }
+        }
+    }
+
+    const size_t n_;
+    const IndicatorConfig config_;
+    const bool simd_;
+    const size_t window_;  // rows of the close ring
+    size_t steps_ = 0;
+
+    std::vector<double> closes_;
+    std::vector<double> zeros_;
+    std::vector<double> high_, low_, volume_, prev_close_;
+    std::vector<double> sma_sum_, sma_;
+    std::vector<double> ema_;
+    std::vector<double> pv_, vol_sum_, vwap_;
+    std::vector<double> avg_gain_, avg_loss_, rsi_;
+    std::vector<double> atr_;
+    std::vector<double> bb_sum_, bb_sum_sq_, bb_mid_, bb_upper_, bb_lower_;
+};
+
+}  // namespace shm_spmc
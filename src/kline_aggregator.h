@@ -0,0 +1,187 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace shm_spmc {
+
+// a kline of any interval, e.g. a parsed Binance kline event ("t", "T", "o", "h", "l", "c", "v",
+// "n", "x") or a bar published by KlineAggregator
+struct KlineBar {
+    uint32_t sym_id;
+    uint32_t closed;      // 1 for the final update of the kline, "x"
+    int64_t open_time;    // ms since the epoch
+    int64_t close_time;   // ms, open_time + interval - 1
+    double open;
+    double high;
+    double low;
+    double close;
+    double volume;
+    uint64_t num_trades;
+};
+
+// Builds higher-interval klines (e.g. 5m, 15m, 1h, 4h) incrementally from a stream of 1m kline
+// updates and publishes every interval to its own SPMC buffer, so only the 1m stream has to be
+// ingested.
+//
+// Binance sends a 1m kline many times while it is open (x=false), each time with the values so
+// far, then once more when it closes (x=true). So per symbol and interval the aggregator keeps the
+// closed 1m klines of the current bar folded into one, plus the latest update of the open minute,
+// which the next update of that minute replaces. Every update publishes the bar as it stands: open
+// of the first minute, high/low over all, close of the latest, summed volume and trades. The bar
+// is published with `closed` set once its last minute closes, or, if that update was missed, when
+// the next bar starts. Stale updates (of a closed or earlier minute) are dropped.
+//
+// Bars are aligned to the epoch, as Binance does (4h bars open at 0:00, 4:00, ... UTC). Symbols
+// are dense ids < `max_symbols`, and all state is allocated up front, so update() doesn't allocate.
+// `Producer` is e.g. PShmBBufferLockFree<KlineBar, true>, or PShmSegmentedLog<KlineBar, true> for
+// an endless feed, the aggregator doesn't own them.
+template <typename Producer>
+class KlineAggregator {
+public:
+    static constexpr int64_t kMinuteMs = 60'000;
+
+    explicit KlineAggregator(size_t max_symbols) : max_symbols_(max_symbols) {}
+
+    // publishes bars of `minutes` to `output`, call before the first update()
+    void add_interval(int minutes, Producer *output) {
+        intervals_.push_back({minutes * kMinuteMs, output, std::vector<SymbolState>(max_symbols_)});
+    }
+
+    // Folds in an update of a 1m kline and publishes the updated bar of every interval.
+    // Returns false if an output couldn't take its bar. That interval's state doesn't include the
+    // update then, so call update() with the same kline again, e.g. once the consumers have caught
+    // up. The retry resumes at that interval, the ones before it don't publish their bars twice.
+    bool update(const KlineBar &kline) {
+        if (unlikely(kline.sym_id >= max_symbols_)) {
+            // once, a feed with too many symbols would flood stderr
+            if (num_dropped_++ == 0)
+                fprintf(stderr, "kline aggregator: sym_id %u >= max_symbols %zu, dropping\n",
+                        kline.sym_id, max_symbols_);
+            return true;
+        }
+        size_t i = 0;
+        if (has_pending_ && memcmp(&kline, &pending_, sizeof kline) == 0)
+            i = pending_interval_;
+        has_pending_ = false;
+        for (; i < intervals_.size(); i++) {
+            if (!update(intervals_[i], kline)) {
+                pending_ = kline;
+                pending_interval_ = i;
+                has_pending_ = true;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t num_intervals() const { return intervals_.size(); }
+
+    // # of updates dropped as their sym_id >= max_symbols
+    uint64_t num_dropped() const { return num_dropped_; }
+
+private:
+    struct SymbolState {
+        int64_t bar_open = -1;    // open time of the current bar
+        int64_t last_closed = -1;  // open time of the last 1m kline folded into `done`
+        bool has_done = false;
+        bool has_open = false;
+        bool published_closed = false;
+        KlineBar done;  // closed 1m klines of the bar so far
+        KlineBar open;  // latest update of the open minute
+    };
+
+    struct Interval {
+        int64_t ms;
+        Producer *output;
+        std::vector<SymbolState> states;
+    };
+
+    static void merge(KlineBar &bar, const KlineBar &kline) {
+        bar.high = std::max(bar.high, kline.high);
+        bar.low = std::min(bar.low, kline.low);
+        bar.close = kline.close;
+        bar.volume += kline.volume;
+        bar.num_trades += kline.num_trades;
+    }
+
+    // folds the open minute's latest update into `done`
+    static void close_minute(SymbolState &st, const KlineBar &kline) {
+        if (st.has_done) {
+            merge(st.done, kline);
+        } else {
+            st.done = kline;
+            st.has_done = true;
+        }
+        st.last_closed = kline.open_time;
+        st.has_open = false;
+    }
+
+    bool publish(Interval &interval, SymbolState &st, bool closed) {
+        KlineBar bar = st.has_done ? st.done : st.open;
+        if (st.has_done && st.has_open)
+            merge(bar, st.open);
+        bar.open_time = st.bar_open;
+        bar.close_time = st.bar_open + interval.ms - 1;
+        bar.closed = closed;
+        st.published_closed = closed;
+        return interval.output->produce(bar);
+    }
+
+    // works on a copy of the symbol's state and stores it only once its bar is published
+    bool update(Interval &interval, const KlineBar &kline) {
+        SymbolState &st = interval.states[kline.sym_id];
+        int64_t bar_open = kline.open_time - kline.open_time % interval.ms;
+        if (bar_open < st.bar_open || kline.open_time <= st.last_closed)
+            return true;  // stale
+
+        SymbolState next = st;
+        if (bar_open != next.bar_open) {
+            // the last minute of the previous bar never closed, its latest update is final
+            if (next.bar_open != -1 && !next.published_closed) {
+                if (next.has_open)
+                    close_minute(next, next.open);
+                if (!publish(interval, next, true))
+                    return false;
+            }
+            next.bar_open = bar_open;
+            next.last_closed = -1;
+            next.has_done = next.has_open = next.published_closed = false;
+            // the previous bar is out, a retry starts from the new one
+            st = next;
+        } else if (next.has_open && kline.open_time != next.open.open_time) {
+            if (kline.open_time < next.open.open_time)
+                return true;  // stale
+            // a new minute started, the previous one's final update was missed
+            close_minute(next, next.open);
+        }
+
+        if (kline.closed) {
+            close_minute(next, kline);
+        } else {
+            next.open = kline;
+            next.has_open = true;
+        }
+        bool bar_closed = kline.closed && kline.open_time + kMinuteMs == bar_open + interval.ms;
+        if (!publish(interval, next, bar_closed))
+            return false;
+        st = next;
+        return true;
+    }
+
+    const size_t max_symbols_;
+    std::vector<Interval> intervals_;
+    uint64_t num_dropped_ = 0;
+
+    // the update that an output couldn't take, and the interval to retry it from
+    KlineBar pending_;
+    size_t pending_interval_ = 0;
+    bool has_pending_ = false;
+};
+
+}  // namespace shm_spmc
@@ -59,11 +59,25 @@ inline bool kline_is_closed(yyjson_val *k_obj) {
     return yyjson_get_bool(yyjson_obj_get(k_obj, "x"));
 }
 
+// -1 if there has been no trade in the kline yet
+inline int64_t kline_get_last_trade_id(yyjson_val *k_obj) {
+    yyjson_val *val = yyjson_obj_get(k_obj, "L");
+    return yyjson_is_sint(val) ? yyjson_get_sint(val) : (int64_t)yyjson_get_uint(val);
+}
+
 inline void print_kline_data(std::string_view message) {
     yyjson_doc *doc = yyjson_read(message.data(), message.size(), 0);
     yyjson_val *root = yyjson_doc_get_root(doc);
     yyjson_val *k_obj = yyjson_obj_get(root, "k");
-    if (k_obj) {
+    const char *event_type = yyjson_get_str(yyjson_obj_get(root, "e"));
+    if (event_type && strcmp(event_type, "gap") == 0) {
+        // recorded by the producer for data it may have missed, see BinanceKlineClient
+        uint64_t from = yyjson_get_uint(yyjson_obj_get(root, "from"));
+        uint64_t to = yyjson_get_uint(yyjson_obj_get(root, "to"));
+        std::cout << "Gap in symbol: " << yyjson_get_str(yyjson_obj_get(root, "s")) << "\n"
+                  << "  From: " << timestamp_ms_to_str(from) << "\n"
+                  << "  To: " << timestamp_ms_to_str(to) << "\n\n";
+    } else if (k_obj) {
         uint64_t event_time = yyjson_get_uint(yyjson_obj_get(root, "E"));
         std::cout << "Event time: " << timestamp_ms_to_str(event_time) << "\n"
                   << "Symbol: " << yyjson_get_str(yyjson_obj_get(root, "s")) << "\n"
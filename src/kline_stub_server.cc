@@ -0,0 +1,131 @@
+// A local stand-in for the Binance kline stream, for testing the producer's A/B arbitration
+// and reconnects without hitting the real exchange.
+//
+// Every connected client gets the same `<symbol>@kline_1m`-style updates. A "minute" lasts
+// `updates_per_kline` updates, the last of which closes the kline (x=true). With `drop_every`
+// set, one client connection is closed every `drop_every` updates.
+#include "websocketpp/config/asio_no_tls.hpp"
+#include "websocketpp/server.hpp"
+
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+typedef websocketpp::server<websocketpp::config::asio> WebSocketServer;
+
+class KlineStubServer {
+public:
+    KlineStubServer(long interval_ms, int updates_per_kline, int drop_every)
+        : interval_ms_(interval_ms), updates_per_kline_(updates_per_kline), drop_every_(drop_every) {
+        server_.init_asio();
+        server_.set_reuse_addr(true);
+        server_.clear_access_channels(websocketpp::log::alevel::frame_header |
+                                      websocketpp::log::alevel::frame_payload);
+        server_.set_open_handler([this](websocketpp::connection_hdl hdl) {
+            clients_.insert(hdl);
+            std::cout << "Client connected, # of clients: " << clients_.size() << "\n";
+        });
+        server_.set_close_handler([this](websocketpp::connection_hdl hdl) {
+            clients_.erase(hdl);
+            std::cout << "Client disconnected, # of clients: " << clients_.size() << "\n";
+        });
+    }
+
+    void run(uint16_t port) {
+        server_.listen(port);
+        server_.start_accept();
+        schedule_update();
+        server_.run();
+    }
+
+private:
+    void schedule_update() {
+        server_.set_timer(interval_ms_, [this](const websocketpp::lib::error_code &ec) {
+            if (ec)
+                return;
+            send_update();
+            schedule_update();
+        });
+    }
+
+    void send_update() {
+        constexpr uint64_t minute_ms = 60'000;
+        int seq = update_cnt_ % updates_per_kline_;
+        if (seq == 0) {
+            open_time_ += minute_ms;
+            first_trade_id_ = last_trade_id_ + 1;
+            open_ = close_;
+            high_ = low_ = open_;
+            volume_ = 0;
+        }
+        int trades = dis_(gen_) % 5;
+        last_trade_id_ += trades;
+        close_ += (dis_(gen_) % 21 - 10) * 0.01;
+        high_ = std::max(high_, close_);
+        low_ = std::min(low_, close_);
+        volume_ += trades * 0.001;
+        bool closed = seq == updates_per_kline_ - 1;
+        int64_t first = last_trade_id_ < first_trade_id_ ? -1 : first_trade_id_;
+        int64_t last = last_trade_id_ < first_trade_id_ ? -1 : last_trade_id_;
+
+        char msg[512];
+        snprintf(msg, sizeof msg,
+                 R"({"e":"kline","E":%lu,"s":"BTCUSDT","k":{"t":%lu,"T":%lu,"s":"BTCUSDT",)"
+                 R"("i":"1m","f":%ld,"L":%ld,"o":"%.2f","c":"%.2f","h":"%.2f","l":"%.2f",)"
+                 R"("v":"%.3f","n":%ld,"x":%s,"q":"0","V":"0","Q":"0","B":"0"}})",
+                 open_time_ + seq * minute_ms / updates_per_kline_, open_time_,
+                 open_time_ + minute_ms - 1, first, last, open_, close_, high_, low_, volume_,
+                 last < 0 ? 0 : last - first + 1, closed ? "true" : "false");
+
+        // copy, as closing a connection may run the close handler
+        std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>>
+            clients = clients_;
+        for (const auto &hdl : clients) {
+            websocketpp::lib::error_code ec;
+            server_.send(hdl, msg, websocketpp::frame::opcode::text, ec);
+        }
+
+        update_cnt_++;
+        if (drop_every_ > 0 && update_cnt_ % drop_every_ == 0 && !clients.empty()) {
+            auto it = std::next(clients.begin(), dis_(gen_) % clients.size());
+            websocketpp::lib::error_code ec;
+            server_.close(*it, websocketpp::close::status::going_away, "dropped by stub", ec);
+            std::cout << "Dropped a client\n";
+        }
+    }
+
+    WebSocketServer server_;
+    std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> clients_;
+
+    const long interval_ms_;
+    const int updates_per_kline_;
+    const int drop_every_;
+
+    std::mt19937 gen_{12345};
+    std::uniform_int_distribution<int> dis_{0, 1 << 20};
+    uint64_t update_cnt_ = 0;
+    uint64_t open_time_ = 1734255540000 - 60'000;
+    int64_t first_trade_id_ = 0;
+    int64_t last_trade_id_ = 4273836661;
+    double open_ = 102070.35, close_ = 102070.35, high_ = 0, low_ = 0, volume_ = 0;
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " port [interval_ms = 100] [updates_per_kline = 20] [drop_every = 0]\n";
+        return -1;
+    }
+
+    const uint16_t port = std::atoi(argv[1]);
+    const long interval_ms = argc > 2 ? std::atol(argv[2]) : 100;
+    const int updates_per_kline = argc > 3 ? std::atoi(argv[3]) : 20;
+    const int drop_every = argc > 4 ? std::atoi(argv[4]) : 0;
+
+    KlineStubServer server(interval_ms, updates_per_kline, drop_every);
+    server.run(port);
+    return 0;
+}
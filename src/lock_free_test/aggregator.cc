@@ -0,0 +1,167 @@
+// Feeds a KlineAggregator a simulated Binance 1m kline stream of `sym_cnt` symbols, with
+// `updates_per_min` in-progress (x=false) updates per kline before its final one. Some final
+// updates are missed and some delivered twice. Then it reads back the 5m, 15m, 1h and 4h buffers
+// and checks every bar against one built from the last update of each of its minutes.
+#include "../shm_bbuffer_spmc.h"
+#include "../kline_aggregator.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+using shm_spmc::KlineBar;
+using ShmProducer = shm_spmc::PShmBBufferLockFree<KlineBar, /* IsProducer = */ true>;
+using ShmConsumer = shm_spmc::PShmBBufferLockFree<KlineBar, /* IsProducer = */ false>;
+using Clock = std::chrono::steady_clock;
+
+constexpr int64_t kStartMs = 1'700'006'400'000;  // a multiple of 4h
+constexpr int kIntervals[] = {5, 15, 60, 240};
+
+bool same_values(const KlineBar &a, const KlineBar &b) {
+    return a.open == b.open && a.high == b.high && a.low == b.low && a.close == b.close &&
+           a.volume == b.volume && a.num_trades == b.num_trades;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("Usage: %s <shm_name> <sym_cnt> [num_minutes = 1440] [updates_per_min = 4]\n",
+               argv[0]);
+        return -1;
+    }
+
+    const std::string shm_name = argv[1];
+    const uint32_t sym_cnt = std::atoi(argv[2]);
+    const int num_minutes = argc > 3 ? std::atoi(argv[3]) : 1440;
+    const int updates_per_min = argc > 4 ? std::atoi(argv[4]) : 4;
+    printf("sym_cnt: %u\nnum_minutes: %d\nupdates_per_min: %d\n", sym_cnt, num_minutes,
+           updates_per_min);
+
+    // every update publishes one bar per interval, plus the closed bars of missed final updates
+    const shm_spmc::idx_t cap = (shm_spmc::idx_t)sym_cnt * num_minutes * (updates_per_min + 3);
+    shm_spmc::KlineAggregator<ShmProducer> aggregator(sym_cnt);
+    std::vector<std::unique_ptr<ShmProducer>> outputs;
+    for (int minutes : kIntervals) {
+        std::string name = shm_name + "." + std::to_string(minutes) + "m";
+        outputs.push_back(std::make_unique<ShmProducer>(name.c_str(), cap));
+        aggregator.add_interval(minutes, outputs.back().get());
+    }
+
+    std::mt19937 gen(12345);
+    std::uniform_int_distribution<int> dis(0, 99);
+    std::vector<double> price(sym_cnt, 1000);
+    std::vector<KlineBar> partial(sym_cnt);
+    // the last update delivered of every (symbol, minute), which the bars are checked against,
+    // if any was: with `updates_per_min` 0, a missed final update is the minute's only one
+    std::vector<KlineBar> last_1m((size_t)sym_cnt * num_minutes);
+    std::vector<bool> delivered((size_t)sym_cnt * num_minutes);
+    shm_spmc::idx_t num_updates = 0;
+    double secs = 0;
+
+    for (int m = 0; m < num_minutes; m++) {
+        int64_t open_time = kStartMs + m * 60'000;
+        for (uint32_t k = 0; k < sym_cnt; k++)
+            partial[k] = {k, 0, open_time, open_time + 59'999, price[k], price[k], price[k],
+                          price[k], 0, 0};
+        // round `updates_per_min` is the final update
+        std::vector<KlineBar> updates;
+        for (int j = 0; j <= updates_per_min; j++) {
+            updates.clear();
+            for (uint32_t k = 0; k < sym_cnt; k++) {
+                KlineBar &p = partial[k];
+                double tick = price[k] + dis(gen) - 49;
+                price[k] = std::max(1.0, tick);
+                p.high = std::max(p.high, price[k]);
+                p.low = std::min(p.low, price[k]);
+                p.close = price[k];
+                p.volume += dis(gen);
+                p.num_trades += 1 + dis(gen) % 7;
+                p.closed = j == updates_per_min;
+                // miss 2% of the final updates, but not at the end of the run
+                if (p.closed && m + 1 < num_minutes && dis(gen) < 2)
+                    continue;
+                updates.push_back(p);
+                last_1m[(size_t)k * num_minutes + m] = p;
+                delivered[(size_t)k * num_minutes + m] = true;
+                if (p.closed && dis(gen) < 5)
+                    updates.push_back(p);  // delivered twice
+            }
+            auto start = Clock::now();
+            for (const KlineBar &update : updates) {
+                if (!aggregator.update(update)) {
+                    printf("output buffer is full!\n");
+                    return -1;
+                }
+            }
+            secs += std::chrono::duration<double>(Clock::now() - start).count();
+            num_updates += updates.size();
+        }
+    }
+    printf("%lu 1m updates in %.3fs, %.1fM updates/s (%zu intervals each)\n", num_updates, secs,
+           num_updates / secs / 1e6, aggregator.num_intervals());
+
+    // the producers finish the buffers in their dtors
+    outputs.clear();
+    int errors = 0;
+    for (int minutes : kIntervals) {
+        std::string name = shm_name + "." + std::to_string(minutes) + "m";
+        ShmConsumer consumer(name.c_str());
+        const int64_t interval_ms = minutes * 60'000;
+
+        // last published bar and # of closed ones per (symbol, bar open time)
+        std::map<std::pair<uint32_t, int64_t>, std::pair<KlineBar, int>> bars;
+        KlineBar bar;
+        shm_spmc::idx_t published = 0;
+        while (consumer.consume(bar) == CONSUME_SUCCESS) {
+            published++;
+            auto &[last, num_closed] = bars[{bar.sym_id, bar.open_time}];
+            if (num_closed != 0) {
+                if (errors++ < 10)
+                    printf("%dm: sym %u bar %ld updated after it closed\n", minutes, bar.sym_id,
+                           bar.open_time);
+            }
+            last = bar;
+            num_closed += bar.closed;
+        }
+
+        for (const auto &[key, value] : bars) {
+            const auto &[sym_id, bar_open] = key;
+            const auto &[last, num_closed] = value;
+            int first = (bar_open - kStartMs) / 60'000;
+            int end = std::min<int>(num_minutes, first + minutes);
+            KlineBar expected{};
+            bool has_expected = false;
+            for (int m = first; m < end; m++) {
+                if (!delivered[(size_t)sym_id * num_minutes + m])
+                    continue;
+                const KlineBar &k = last_1m[(size_t)sym_id * num_minutes + m];
+                if (!has_expected) {
+                    expected = k;
+                    has_expected = true;
+                    continue;
+                }
+                expected.high = std::max(expected.high, k.high);
+                expected.low = std::min(expected.low, k.low);
+                expected.close = k.close;
+                expected.volume += k.volume;
+                expected.num_trades += k.num_trades;
+            }
+            bool complete = end - first == minutes;
+            if (!same_values(last, expected) || num_closed != complete ||
+                last.close_time != bar_open + interval_ms - 1) {
+                if (errors++ < 10)
+                    printf("%dm: sym %u bar %ld mismatch (closed %d times)\n", minutes, sym_id,
+                           bar_open, num_closed);
+            }
+        }
+        printf("%dm: %lu updates of %zu bars\n", minutes, published, bars.size());
+        shm_unlink(name.c_str());
+    }
+    printf("%s\n", errors == 0 ? "all bars match" : "MISMATCH");
+    return errors == 0 ? 0 : 1;
+}
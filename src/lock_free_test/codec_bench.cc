@@ -0,0 +1,94 @@
+// Encodes a day of `producer`-like klines with DeltaBlockCodec (one block per timestep), checks
+// that every block decodes back to the same records, and reports the compression ratio and the
+// decode speed of the SIMD and scalar Stream VByte decoders.
+#include "../shm_compressed_log.h"
+#include "data.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace shm_spmc;
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <sym_cnt> [num_timesteps = 2000]\n", argv[0]);
+        return -1;
+    }
+    const int sym_cnt = std::atoi(argv[1]);
+    const int num_steps = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+    // same distribution as producer.cc
+    std::mt19937 gen(12345);
+    std::uniform_int_distribution<int> dis(0, 20);
+    std::vector<KLineData> raw((size_t)sym_cnt * num_steps);
+    for (int s = 0; s < num_steps; s++) {
+        for (int k = 1; k <= sym_cnt; k++) {
+            int rand = dis(gen);
+            raw[(size_t)s * sym_cnt + k - 1] = {(uint32_t)k, 9'30'00'000 + s * 3'000,
+                                                (uint32_t)(k + rand), (uint32_t)rand,
+                                                k + (rand & 5), k + (rand & 3),
+                                                k + (rand & 13), k - (rand & 7)};
+        }
+    }
+
+    std::vector<uint8_t> encoded(num_steps * DeltaBlockCodec<KLineData>::max_block_size(sym_cnt));
+    DeltaBlockCodec<KLineData> encoder;
+    size_t size = 0;
+    auto start = Clock::now();
+    for (int s = 0; s < num_steps; s++)
+        size += encoder.encode(&raw[(size_t)s * sym_cnt], sym_cnt, &encoded[size]);
+    double encode_secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+    size_t raw_size = raw.size() * sizeof(KLineData);
+    printf("raw: %zu bytes, encoded: %zu bytes, ratio: %.2f (%.2f bytes/record)\n", raw_size,
+           size, (double)raw_size / size, (double)size / raw.size());
+    printf("block encode: %.1f M records/s\n", raw.size() / encode_secs / 1e6);
+
+    std::vector<KLineData> decoded(sym_cnt);
+    DeltaBlockCodec<KLineData> checker;
+    for (size_t pos = 0, s = 0; pos < size; s++) {
+        pos += checker.decode(&encoded[pos], decoded.data());
+        if (memcmp(decoded.data(), &raw[s * sym_cnt], sizeof(KLineData) * sym_cnt) != 0) {
+            printf("timestep %zu decoded wrong\n", s);
+            return EXIT_FAILURE;
+        }
+    }
+
+    DeltaBlockCodec<KLineData> decoder;
+    start = Clock::now();
+    for (size_t pos = 0; pos < size;)
+        pos += decoder.decode(&encoded[pos], decoded.data());
+    double block_secs = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("block decode: %.1f M records/s\n", raw.size() / block_secs / 1e6);
+
+    // the integer decoders alone, over the first block's values
+    const size_t n = (size_t)sym_cnt * DeltaBlockCodec<KLineData>::kWords;
+    const uint8_t *values = &encoded[DeltaBlockCodec<KLineData>::kHeaderSize];
+    const size_t values_size =
+        DeltaBlockCodec<KLineData>::block_size(encoded.data()) - DeltaBlockCodec<KLineData>::kHeaderSize;
+    std::vector<uint32_t> simd_out(n), scalar_out(n);
+    constexpr int rounds = 1000;
+
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+        svb_decode(values, values_size, n, simd_out.data());
+    double simd_secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+        svb_decode_scalar(values, n, scalar_out.data());
+    double scalar_secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (simd_out != scalar_out) {
+        printf("SIMD and scalar decoders disagree\n");
+        return EXIT_FAILURE;
+    }
+    printf("svb decode: simd %.0f M ints/s, scalar %.0f M ints/s\n",
+           n * rounds / simd_secs / 1e6, n * rounds / scalar_secs / 1e6);
+    return 0;
+}
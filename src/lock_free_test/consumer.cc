@@ -1,93 +1,112 @@
 #include "../shm_bbuffer_spmc.h"
+#include "../shm_segmented_log.h"
+#include "../shm_time_index.h"
+#include "../shm_compressed_log.h"
+#include "../checkpoint.h"
 #include "data.h"
+#include "factor.h"
 
 #include <fstream>
-#include <queue>
+#include <memory>
+#include <string>
 #include <vector>
 #include <thread>
 #include <unordered_map>
 
-class CumMedian {
-public:
-    CumMedian() = default;
-
-    void insert(int32_t x) {
-        if (low.empty() || x <= low.top())
-            low.push(x);
-        else
-            high.push(x);
-
-        if (low.size() > high.size() + 1) {
-            high.push(low.top());
-            low.pop();
-        } else if (high.size() > low.size()) {
-            low.push(high.top());
-            high.pop();
-        }
+// prints the resident set size and page table size of this process
+void print_mem_usage() {
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.rfind("VmRSS", 0) == 0 || line.rfind("VmPTE", 0) == 0 ||
+            line.rfind("VmHWM", 0) == 0)
+            printf("%s\n", line.c_str());
     }
-
-    int32_t get_median() const {
-        if (low.size() == high.size())
-            return (low.top() + high.top()) / 2.0;
-        return low.top();
-    }
-
-private:
-    std::priority_queue<int32_t> low;
-    std::priority_queue<int32_t, std::vector<int32_t>, std::greater<int32_t>> high;
-};
-
-#ifndef MEDIAN_FACTOR
-#define MEDIAN_FACTOR 1
-#endif
-
-struct StatData {
-    uint64_t vol = 0;
-    uint64_t num_trades = 0;
-#if MEDIAN_FACTOR
-    CumMedian cum_median;
-#endif
-    int32_t factor = 0;
-};
-
-typedef std::unordered_map<uint32_t, StatData> StatMap;
-
-void update_factor(StatMap &stat, const KLineData &kline) {
-    auto it = stat.find(kline.sym_id);
-    if (it == stat.end())
-        it = stat.emplace(kline.sym_id, StatData{}).first;
-
-    StatData &data = it->second;
-    data.vol += kline.volume;
-    data.num_trades += kline.num_trades;
-
-    int32_t typical_price = (kline.high + kline.low + kline.close) / 3;
-#if MEDIAN_FACTOR
-    data.cum_median.insert(kline.close);
-    int32_t median = data.cum_median.get_median();
-    data.factor += typical_price < median ? 1 : -1;
-#else
-    data.factor += typical_price < kline.close ? 1 : -1;
-#endif
+    fflush(stdout);
 }
 
 template <typename T>
 // using ShmConsumer = shm_spmc::PShmBBufferLockFree<T, /* IsProducer = */ false>;
+// using ShmConsumer = shm_spmc::PShmSegmentedLog<T, /* IsProducer = */ false>;
+// using ShmConsumer = shm_spmc::PShmCompressedLog<T, /* IsProducer = */ false>;
 using ShmConsumer = shm_spmc::PShmBBufferGiacomoni<T, /* IsProducer = */ false>;
 
 int main(int argc, char *argv[]) {
     if (argc < 3) {
-        printf("Usage: %s <shm_name> <out_file> \n", argv[0]);
+        printf("Usage: %s <shm_name> <out_file> [prefetch_dist] [release_mb] "
+               "[tidx_shm_name|- start_time] [checkpoint_path [checkpoint_min = 30]]\n",
+               argv[0]);
         return -1;
     }
 
     const char *shm_name = argv[1];
     const char *out_file = argv[2];
+    const int prefetch_dist = argc > 3 ? std::atoi(argv[3]) : 0;
+    // unmap the consumed part of the log every `release_mb` MB, 0 keeps it all mapped
+    const double release_mb = argc > 4 ? std::atof(argv[4]) : 0;
+    printf("prefetch_dist: %d\nrelease_mb: %g\n", prefetch_dist, release_mb);
 
     ShmConsumer<KLineData> shm_buffer(shm_name);
+    shm_buffer.set_prefetch_distance(prefetch_dist);
+    shm_buffer.set_release_chunk(release_mb * 1024 * 1024);
+
+    // optionally start at `start_time` (e.g. 14'00'00'000) instead of the beginning of the log
+    int32_t start_time = 0;
+    shm_spmc::idx_t index = 0;  // of the next kline
+    if (argc > 6 && strcmp(argv[5], "-") != 0) {
+        start_time = std::atoi(argv[6]);
+        shm_spmc::PShmTimeIndex</* IsProducer = */ false> time_index(argv[5]);
+        shm_spmc::idx_t seek_index = time_index.seek(start_time);
+        shm_buffer.seek(seek_index);
+        // seek() stops at what is published or still mapped, count from where it landed
+        index = shm_buffer.position();
+        printf("start_time: %d, seeking to index %lu, at index %lu\n", start_time, seek_index,
+               index);
+    } else if (argc > 6) {
+        start_time = std::atoi(argv[6]);
+    }
     StatMap stat;
     KLineData kline;
 
+    // snapshot the stats every `checkpoint_min` minutes of kline time, and resume from the
+    // latest snapshot if there is one
+    std::unique_ptr<shm_spmc::Checkpoint> checkpoint;
+    std::vector<char> payload;
+    const int checkpoint_min = argc > 8 ? std::atoi(argv[8]) : 30;
+    int checkpoint_time = 0;
+    if (argc > 7) {
+        checkpoint = std::make_unique<shm_spmc::Checkpoint>(argv[7]);
+        shm_spmc::idx_t ckpt_index;
+        if (checkpoint->load(ckpt_index, payload)) {
+            shm_spmc::CheckpointReader reader(payload);
+            if (!reader.get(start_time) || !reader.get(checkpoint_time) ||
+                !load_stats(stat, reader)) {
+                printf("checkpoint %s doesn't match this consumer\n", argv[7]);
+                return -1;
+            }
+            printf("restored %zu symbols from checkpoint, resuming at index %lu\n", stat.size(),
+                   ckpt_index);
+            // A restarted producer may not have reached the checkpoint yet, and seek() stops at
+            // what it has published. Starting there would count klines the stats already hold.
+            shm_buffer.seek(ckpt_index);
+            if (shm_buffer.position() < ckpt_index) {
+                printf("waiting for the producer to reach index %lu\n", ckpt_index);
+                fflush(stdout);
+            }
+            while (shm_buffer.position() < ckpt_index) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                shm_buffer.seek(ckpt_index);
+            }
+            // e.g. a segmented log that reclaimed it
+            if (shm_buffer.position() != ckpt_index) {
+                printf("can't resume at index %lu, the log starts at %lu\n", ckpt_index,
+                       shm_buffer.position());
+                return -1;
+            }
+            index = ckpt_index;
+        }
+    }
+
     constexpr int delta_print_time = 10'00'000;  // every 10 min
     int print_time = 9'30'00'000;
     while (true) {
@@ -96,9 +115,23 @@ int main(int argc, char *argv[]) {
             break;
 
         if (rc == CONSUME_SUCCESS) {
+            if (checkpoint && kline.time >= checkpoint_time) {
+                // covers the klines before this one, written by the checkpoint's own thread
+                payload.clear();
+                shm_spmc::CheckpointWriter writer(payload);
+                checkpoint_time = kline.time + checkpoint_min * 1'00'000;
+                writer.put(start_time);
+                writer.put(checkpoint_time);
+                save_stats(stat, writer);
+                printf("checkpoint at index %lu: %zu bytes\n", index, payload.size());
+                checkpoint->save_async(index, payload);
+            }
+            index++;
+            if (kline.time < start_time)
+                continue;
             if (kline.time >= print_time) {
                 printf("consumer current timepoint: %d\n", kline.time);
-                fflush(stdout);
+                print_mem_usage();
                 print_time = kline.time + delta_print_time;
             }
             update_factor(stat, kline);
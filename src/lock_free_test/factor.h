@@ -0,0 +1,194 @@
+#pragma once
+
+#include "../checkpoint.h"
+#include "data.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Cumulative median of integer prices, kept as a histogram of the distinct prices plus a
+// cursor on the lower median, which moves by at most one element per insert. So the state, and
+// a checkpoint of it, is bounded by the # of distinct prices (ticks) instead of the # of klines.
+class CumMedian {
+public:
+    CumMedian() = default;
+    CumMedian(CumMedian &&other) noexcept { *this = std::move(other); }
+
+    CumMedian &operator=(CumMedian &&other) noexcept {
+        // moving a std::map keeps its nodes, so `mid` stays valid
+        bool empty = other.count == 0;
+        counts = std::move(other.counts);
+        mid = empty ? counts.end() : other.mid;
+        offset = other.offset;
+        count = other.count;
+        other.count = 0;
+        return *this;
+    }
+
+    void insert(int32_t x) {
+        auto [it, inserted] = counts.try_emplace(x, 0);
+        it->second++;
+        if (count++ == 0) {
+            mid = it;
+            offset = 0;
+            return;
+        }
+        // the lower median is element (count - 1) / 2, the cursor's element moved up by one if x
+        // went before it
+        int64_t move = int64_t((count - 1) / 2) - ((count - 2) / 2 + (x < mid->first));
+        if (move > 0) {
+            if (++offset == mid->second) {
+                ++mid;
+                offset = 0;
+            }
+        } else if (move < 0) {
+            if (offset-- == 0) {
+                --mid;
+                offset = mid->second - 1;
+            }
+        }
+    }
+
+    int32_t get_median() const {
+        if (count % 2 == 0) {
+            int32_t upper = offset + 1 < mid->second ? mid->first : std::next(mid)->first;
+            return (mid->first + upper) / 2.0;
+        }
+        return mid->first;
+    }
+
+    // the histogram as (price, count) pairs in price order
+    void save(shm_spmc::CheckpointWriter &writer) const {
+        writer.put<uint64_t>(counts.size());
+        for (const auto &[price, n] : counts) {
+            writer.put(price);
+            writer.put(n);
+        }
+    }
+
+    bool load(shm_spmc::CheckpointReader &reader) {
+        uint64_t n;
+        if (!reader.get(n) || n > reader.remaining() / (sizeof(int32_t) + sizeof(uint32_t)))
+            return false;
+        counts.clear();
+        count = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            int32_t price;
+            uint32_t cnt;
+            if (!reader.get(price) || !reader.get(cnt) || cnt == 0 ||
+                (!counts.empty() && price <= counts.rbegin()->first))
+                return false;
+            counts.emplace_hint(counts.end(), price, cnt);
+            count += cnt;
+        }
+        // put the cursor on element (count - 1) / 2
+        mid = counts.begin();
+        offset = 0;
+        for (uint64_t left = count == 0 ? 0 : (count - 1) / 2; left > 0;) {
+            uint64_t step = std::min<uint64_t>(left, mid->second - offset);
+            left -= step;
+            offset += step;
+            if (offset == mid->second) {
+                ++mid;
+                offset = 0;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::map<int32_t, uint32_t> counts;  // price -> # of klines that closed at it
+    std::map<int32_t, uint32_t>::iterator mid = counts.end();  // bucket of the lower median
+    uint32_t offset = 0;  // the lower median is copy `offset` of `mid`'s price
+    uint64_t count = 0;
+};
+
+#ifndef MEDIAN_FACTOR
+#define MEDIAN_FACTOR 1
+#endif
+
+struct StatData {
+    uint64_t vol = 0;
+    uint64_t num_trades = 0;
+#if MEDIAN_FACTOR
+    CumMedian cum_median;
+#endif
+    int32_t factor = 0;
+};
+
+typedef std::unordered_map<uint32_t, StatData> StatMap;
+
+// returns the updated state of the kline's symbol
+inline StatData &update_factor(StatMap &stat, const KLineData &kline) {
+    auto it = stat.find(kline.sym_id);
+    if (it == stat.end())
+        it = stat.emplace(kline.sym_id, StatData{}).first;
+
+    StatData &data = it->second;
+    data.vol += kline.volume;
+    data.num_trades += kline.num_trades;
+
+    int32_t typical_price = (kline.high + kline.low + kline.close) / 3;
+#if MEDIAN_FACTOR
+    data.cum_median.insert(kline.close);
+    int32_t median = data.cum_median.get_median();
+    data.factor += typical_price < median ? 1 : -1;
+#else
+    data.factor += typical_price < kline.close ? 1 : -1;
+#endif
+    return data;
+}
+
+// Appends the factor state of every symbol to a checkpoint payload, 8 bytes per distinct close
+// for the medians.
+inline void save_stats(const StatMap &stat, shm_spmc::CheckpointWriter &writer) {
+    writer.put<uint32_t>(MEDIAN_FACTOR);
+    writer.put<uint64_t>(stat.size());
+    for (const auto &[sym_id, data] : stat) {
+        writer.put(sym_id);
+        writer.put(data.vol);
+        writer.put(data.num_trades);
+        writer.put(data.factor);
+#if MEDIAN_FACTOR
+        data.cum_median.save(writer);
+#endif
+    }
+}
+
+// returns false if the payload is truncated or wasn't written by save_stats() (e.g. with a
+// different MEDIAN_FACTOR)
+inline bool load_stats(StatMap &stat, shm_spmc::CheckpointReader &reader) {
+    uint32_t median_factor;
+    uint64_t n;
+    if (!reader.get(median_factor) || median_factor != MEDIAN_FACTOR || !reader.get(n))
+        return false;
+    stat.clear();
+    stat.reserve(n);
+    for (uint64_t i = 0; i < n; i++) {
+        uint32_t sym_id;
+        StatData data;
+        if (!reader.get(sym_id) || !reader.get(data.vol) || !reader.get(data.num_trades) ||
+            !reader.get(data.factor))
+            return false;
+#if MEDIAN_FACTOR
+        if (!data.cum_median.load(reader))
+            return false;
+#endif
+        stat.emplace(sym_id, std::move(data));
+    }
+    return true;
+}
+
+// the factor state of a symbol after one of its klines, published by `factor_stage`
+struct FactorData {
+    uint32_t sym_id;
+    int32_t time;
+    uint64_t vol;
+    uint64_t num_trades;
+    int32_t factor;
+    int32_t median;  // cumulative median close, 0 without MEDIAN_FACTOR
+};
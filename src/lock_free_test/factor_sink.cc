@@ -0,0 +1,48 @@
+// Reads the FactorData stream of `factor_stage` and writes the same csv as `consumer`, without
+// recomputing the factors.
+#include "../shm_bbuffer_spmc.h"
+#include "factor.h"
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+#include <cstdio>
+
+template <typename T>
+using ShmConsumer = shm_spmc::PShmBBufferLockFree<T, /* IsProducer = */ false>;
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("Usage: %s <factor_shm_name> <out_file>\n", argv[0]);
+        return -1;
+    }
+
+    ShmConsumer<FactorData> shm_buffer(argv[1]);
+    std::unordered_map<uint32_t, FactorData> last;
+    FactorData data;
+
+    constexpr int delta_print_time = 10'00'000;  // every 10 min
+    int print_time = 9'30'00'000;
+    while (true) {
+        int rc = shm_buffer.consume(data);
+        if (rc == CONSUME_FINISHED)
+            break;
+
+        if (rc == CONSUME_SUCCESS) {
+            if (data.time >= print_time) {
+                printf("factor sink current timepoint: %d\n", data.time);
+                fflush(stdout);
+                print_time = data.time + delta_print_time;
+            }
+            last[data.sym_id] = data;
+        } else {  // CONSUME_AGAIN
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    std::ofstream ofs(argv[2]);
+    ofs << "sym_id,vol,num_trades,factor\n";
+    for (const auto &[sym_id, d] : last)
+        ofs << sym_id << "," << d.vol << "," << d.num_trades << "," << d.factor << "\n";
+}
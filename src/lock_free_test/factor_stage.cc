@@ -0,0 +1,58 @@
+// A pipeline stage that computes the factors of `consumer` once and publishes every update as a
+// FactorData stream, which any number of `factor_sink`s (or further stages) can read.
+#include "../shm_bbuffer_spmc.h"
+#include "../shm_pipeline_stage.h"
+#include "data.h"
+#include "factor.h"
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+// reads a log written by `producer`, same alias as consumer.cc
+template <typename T>
+using ShmConsumer = shm_spmc::PShmBBufferGiacomoni<T, /* IsProducer = */ false>;
+
+template <typename T>
+using ShmProducer = shm_spmc::PShmBBufferLockFree<T, /* IsProducer = */ true>;
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s <in_shm_name> <out_shm_name> <size_gb> [batch_size = 1024]\n", argv[0]);
+        return -1;
+    }
+
+    const char *in_shm_name = argv[1];
+    const char *out_shm_name = argv[2];
+    double size_gb = std::atof(argv[3]);
+    const size_t batch_size = argc > 4 ? std::atol(argv[4]) : 1024;
+    printf("in_shm_name: %s\nout_shm_name: %s\nbatch_size: %zu\n", in_shm_name, out_shm_name,
+           batch_size);
+
+    constexpr size_t GB = 1024 * 1024 * 1024;
+    ShmConsumer<KLineData> input(in_shm_name);
+    ShmProducer<FactorData> output(out_shm_name, size_gb * GB / sizeof(FactorData));
+
+    StatMap stat;
+    auto compute = [&stat](size_t, const KLineData *klines, size_t n,
+                           std::vector<FactorData> &out) {
+        for (size_t i = 0; i < n; i++) {
+            const KLineData &kline = klines[i];
+            StatData &data = update_factor(stat, kline);
+#if MEDIAN_FACTOR
+            int32_t median = data.cum_median.get_median();
+#else
+            int32_t median = 0;
+#endif
+            out.push_back({kline.sym_id, kline.time, data.vol, data.num_trades, data.factor,
+                           median});
+        }
+    };
+
+    shm_spmc::PipelineStage<KLineData, FactorData, ShmConsumer<KLineData>,
+                            ShmProducer<FactorData>, decltype(compute)>
+        stage({&input}, output, compute, batch_size);
+    stage.run();
+    printf("consumed: %lu, produced: %lu\n", stage.consumed_items(), stage.produced_items());
+    return 0;
+}
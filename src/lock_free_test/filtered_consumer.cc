@@ -0,0 +1,63 @@
+#include "../shm_symbol_index.h"
+#include "data.h"
+
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+// reads a log written by `producer` with the PShmBBufferSymIndexed alias
+template <typename T>
+using ShmConsumer = shm_spmc::PShmBBufferSymIndexed<T, /* IsProducer = */ false>;
+
+struct SymStat {
+    uint64_t cnt = 0;
+    uint64_t vol = 0;
+    int32_t last_time = 0;
+    int32_t last_close = 0;
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <shm_name> [sym_id ...]\n", argv[0]);
+        printf("Reads every record if no sym_id is given.\n");
+        return -1;
+    }
+
+    ShmConsumer<KLineData> shm_buffer(argv[1]);
+    std::vector<uint32_t> sym_ids;
+    for (int i = 2; i < argc; i++)
+        sym_ids.push_back(std::atoi(argv[i]));
+    if (!sym_ids.empty())
+        shm_buffer.subscribe(sym_ids);
+
+    std::map<uint32_t, SymStat> stat;
+    KLineData kline;
+    int32_t last_time = 0;
+    uint64_t out_of_order = 0;
+    while (true) {
+        int rc = shm_buffer.consume(kline);
+        if (rc == CONSUME_FINISHED)
+            break;
+
+        if (rc == CONSUME_SUCCESS) {
+            if (kline.time < last_time)
+                out_of_order++;
+            last_time = kline.time;
+            SymStat &s = stat[kline.sym_id];
+            s.cnt++;
+            s.vol += kline.volume;
+            s.last_time = kline.time;
+            s.last_close = kline.close;
+        } else {  // CONSUME_AGAIN
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    printf("sym_id,cnt,vol,last_time,last_close\n");
+    for (const auto &[sym_id, s] : stat)
+        printf("%u,%lu,%lu,%d,%d\n", sym_id, s.cnt, s.vol, s.last_time, s.last_close);
+    printf("out of order records: %lu\n", out_of_order);
+}
@@ -0,0 +1,224 @@
+// Compares the SIMD indicator kernels (AVX2 / NEON) to the scalar reference: each kernel on its
+// own, then an IndicatorEngine of `sym_cnt` symbols updating all indicators every timestep on a
+// random walk, checking both engines agree, and exits with 1 if they don't. With `shm_name` it
+// then runs the engine on a log written by `producer`, one update per kline time.
+#include "../shm_bbuffer_spmc.h"
+#include "../indicators.h"
+#include "data.h"
+
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using shm_spmc::IndicatorEngine;
+using Clock = std::chrono::steady_clock;
+
+template <typename T>
+// using ShmConsumer = shm_spmc::PShmBBufferLockFree<T, /* IsProducer = */ false>;
+using ShmConsumer = shm_spmc::PShmBBufferGiacomoni<T, /* IsProducer = */ false>;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// ns per symbol of `fn(simd)` over `reps` runs
+double time_kernel(const std::function<void(bool)> &fn, bool simd, size_t n, int reps) {
+    fn(simd);  // warm up
+    auto start = Clock::now();
+    for (int r = 0; r < reps; r++)
+        fn(simd);
+    return seconds_since(start) * 1e9 / reps / n;
+}
+
+void bench_kernels(size_t n) {
+    std::mt19937 gen(12345);
+    std::uniform_real_distribution<double> dis(90, 110);
+    auto column = [&]() {
+        std::vector<double> v(n);
+        for (double &x : v)
+            x = dis(gen);
+        return v;
+    };
+    std::vector<double> close = column(), prev = column(), high = column(), low = column(),
+                        volume = column(), old = column();
+    std::vector<double> s1(n), s2(n), out1(n), out2(n), out3(n);
+    const int reps = std::max<int>(10, 100'000'000 / n / 8);
+
+    struct Kernel {
+        const char *name;
+        std::function<void(bool)> fn;
+    };
+    Kernel kernels[] = {
+        {"sma", [&](bool simd) {
+             shm_spmc::sma_update(s1.data(), close.data(), old.data(), 0.05, out1.data(), n, simd);
+         }},
+        {"ema", [&](bool simd) { shm_spmc::ema_update(s1.data(), close.data(), 0.1, n, simd); }},
+        {"vwap", [&](bool simd) {
+             shm_spmc::vwap_update(s1.data(), s2.data(), high.data(), low.data(), close.data(),
+                                   volume.data(), out1.data(), n, simd);
+         }},
+        {"rsi", [&](bool simd) {
+             shm_spmc::rsi_update(s1.data(), s2.data(), prev.data(), close.data(), 1.0 / 14,
+                                  out1.data(), n, simd);
+         }},
+        {"atr", [&](bool simd) {
+             shm_spmc::atr_update(s1.data(), prev.data(), high.data(), low.data(), 1.0 / 14, n,
+                                  simd);
+         }},
+        {"bollinger", [&](bool simd) {
+             shm_spmc::bollinger_update(s1.data(), s2.data(), close.data(), old.data(), 0.05, 2.0,
+                                        out1.data(), out2.data(), out3.data(), n, simd);
+         }},
+    };
+
+    printf("%-10s %12s %12s %8s\n", "kernel", "scalar ns/sym", "simd ns/sym", "speedup");
+    for (const Kernel &k : kernels) {
+        std::fill(s1.begin(), s1.end(), 0.0);
+        std::fill(s2.begin(), s2.end(), 0.0);
+        double scalar = time_kernel(k.fn, false, n, reps);
+        double simd = time_kernel(k.fn, true, n, reps);
+        printf("%-10s %12.3f %12.3f %7.2fx\n", k.name, scalar, simd, scalar / simd);
+    }
+}
+
+// returns the max abs difference between all outputs of the two engines
+double max_diff(const IndicatorEngine &a, const IndicatorEngine &b) {
+    using Output = const double *(IndicatorEngine::*)() const;
+    const Output outputs[] = {&IndicatorEngine::sma,    &IndicatorEngine::ema,
+                              &IndicatorEngine::vwap,   &IndicatorEngine::rsi,
+                              &IndicatorEngine::atr,    &IndicatorEngine::bb_mid,
+                              &IndicatorEngine::bb_upper, &IndicatorEngine::bb_lower};
+    double diff = 0;
+    for (Output output : outputs) {
+        const double *x = (a.*output)(), *y = (b.*output)();
+        for (size_t i = 0; i < a.num_symbols(); i++)
+            diff = std::max(diff, std::fabs(x[i] - y[i]));
+    }
+    return diff;
+}
+
+// returns the max difference between the scalar and the SIMD engine
+double bench_engine(size_t n, int num_timesteps) {
+    IndicatorEngine scalar(n, {}, /* simd = */ false);
+    IndicatorEngine simd(n, {}, /* simd = */ true);
+    std::mt19937 gen(12345);
+    std::uniform_int_distribution<int> dis(0, 20);
+    std::vector<double> close(n, 1000), high(n), low(n), volume(n);
+    double scalar_secs = 0, simd_secs = 0, diff = 0;
+
+    for (int t = 0; t < num_timesteps; t++) {
+        for (size_t i = 0; i < n; i++) {
+            int rand = dis(gen);
+            close[i] += rand - 10;
+            high[i] = close[i] + (rand & 3);
+            low[i] = close[i] - (rand & 5);
+            volume[i] = rand * 10;
+        }
+        for (IndicatorEngine *engine : {&scalar, &simd}) {
+            std::copy(close.begin(), close.end(), engine->column(IndicatorEngine::CLOSE));
+            std::copy(high.begin(), high.end(), engine->column(IndicatorEngine::HIGH));
+            std::copy(low.begin(), low.end(), engine->column(IndicatorEngine::LOW));
+            std::copy(volume.begin(), volume.end(), engine->column(IndicatorEngine::VOLUME));
+        }
+
+        auto start = Clock::now();
+        scalar.update();
+        scalar_secs += seconds_since(start);
+        start = Clock::now();
+        simd.update();
+        simd_secs += seconds_since(start);
+        diff = std::max(diff, max_diff(scalar, simd));
+    }
+    printf("engine: %zu symbols x %d timesteps, all 6 indicators each timestep\n", n,
+           num_timesteps);
+    printf("  scalar: %8.2f us/timestep, %6.3f ns/symbol\n", scalar_secs * 1e6 / num_timesteps,
+           scalar_secs * 1e9 / num_timesteps / n);
+    printf("  simd:   %8.2f us/timestep, %6.3f ns/symbol (%.2fx)\n",
+           simd_secs * 1e6 / num_timesteps, simd_secs * 1e9 / num_timesteps / n,
+           scalar_secs / simd_secs);
+    printf("  max difference scalar vs simd: %g\n", diff);
+    return diff;
+}
+
+// Feeds the engine from a log of KLineData with sym_ids 1..n, one timestep per kline time. A
+// symbol without a kline in a timestep keeps its last close, with no range and no volume.
+void run_log(const char *shm_name, size_t n) {
+    ShmConsumer<KLineData> shm_buffer(shm_name);
+    IndicatorEngine engine(n);
+    std::vector<double> last_close(n);
+    double *close;
+    KLineData kline;
+    int32_t time = -1;
+    double update_secs = 0;
+    shm_spmc::idx_t klines = 0;
+
+    // the close column is a ring row, which still holds an old timestep
+    auto start_timestep = [&]() {
+        close = engine.column(IndicatorEngine::CLOSE);
+        std::copy(last_close.begin(), last_close.end(), close);
+        std::copy(last_close.begin(), last_close.end(), engine.column(IndicatorEngine::HIGH));
+        std::copy(last_close.begin(), last_close.end(), engine.column(IndicatorEngine::LOW));
+        std::fill_n(engine.column(IndicatorEngine::VOLUME), n, 0.0);
+    };
+    auto update = [&]() {
+        auto start = Clock::now();
+        engine.update();
+        update_secs += seconds_since(start);
+        start_timestep();
+    };
+    start_timestep();
+    int rc;
+    while ((rc = shm_buffer.consume(kline)) != CONSUME_FINISHED) {
+        if (rc == CONSUME_AGAIN)
+            continue;
+        if (kline.time != time && time != -1)
+            update();
+        time = kline.time;
+        if (kline.sym_id == 0 || kline.sym_id > n)
+            continue;
+        size_t i = kline.sym_id - 1;
+        close[i] = last_close[i] = kline.close;
+        engine.column(IndicatorEngine::HIGH)[i] = kline.high;
+        engine.column(IndicatorEngine::LOW)[i] = kline.low;
+        engine.column(IndicatorEngine::VOLUME)[i] = kline.volume;
+        klines++;
+    }
+    if (time != -1)
+        update();
+
+    printf("log: %lu klines, %zu timesteps, %.2f us per update of %zu symbols\n", klines,
+           engine.timesteps(), update_secs * 1e6 / std::max<size_t>(1, engine.timesteps()), n);
+    printf("sym_id 1: sma %.2f ema %.2f vwap %.2f rsi %.2f atr %.2f bb [%.2f, %.2f]\n",
+           engine.sma()[0], engine.ema()[0], engine.vwap()[0], engine.rsi()[0], engine.atr()[0],
+           engine.bb_lower()[0], engine.bb_upper()[0]);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <sym_cnt> [num_timesteps = 2000] [shm_name]\n", argv[0]);
+        return -1;
+    }
+
+    const size_t sym_cnt = std::atoi(argv[1]);
+    const int num_timesteps = argc > 2 ? std::atoi(argv[2]) : 2000;
+#if defined(__aarch64__)
+    const char *isa = "neon";
+#else
+    const char *isa = "avx2";
+#endif
+    printf("sym_cnt: %zu\nsimd: %s\n", sym_cnt, shm_spmc::detail::has_simd() ? isa : "none");
+
+    bench_kernels(sym_cnt);
+    if (bench_engine(sym_cnt, num_timesteps) != 0) {
+        printf("MISMATCH: the SIMD engine differs from the scalar one\n");
+        return 1;
+    }
+    if (argc > 3)
+        run_log(argv[3], sym_cnt);
+    return 0;
+}
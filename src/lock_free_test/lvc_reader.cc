@@ -0,0 +1,46 @@
+#include "../shm_last_value_cache.h"
+#include "data.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+template <typename T>
+using ShmLastValueCache = shm_spmc::PShmLastValueCache<T, /* IsProducer = */ false>;
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("Usage: %s <lvc_shm_name> <sym_id> [sym_id ...]\n", argv[0]);
+        return -1;
+    }
+
+    ShmLastValueCache<KLineData> lvc(argv[1]);
+    std::vector<uint32_t> sym_ids;
+    for (int i = 2; i < argc; i++) {
+        uint32_t sym_id = std::atoi(argv[i]);
+        if (sym_id >= lvc.capacity()) {
+            printf("sym_id %u out of range [0, %lu)\n", sym_id, lvc.capacity());
+            return -1;
+        }
+        sym_ids.push_back(sym_id);
+    }
+
+    // prints a snapshot of the current klines every second, no replay of the log needed
+    KLineData kline;
+    while (true) {
+        for (uint32_t sym_id : sym_ids) {
+            if (!lvc.read(sym_id, kline)) {
+                printf("sym_id: %u, no data yet\n", sym_id);
+                continue;
+            }
+            printf("sym_id: %u, time: %d, open: %d, high: %d, low: %d, close: %d, volume: %u, "
+                   "version: %u\n",
+                   kline.sym_id, kline.time, kline.open, kline.high, kline.low, kline.close,
+                   kline.volume, lvc.version(sym_id));
+        }
+        fflush(stdout);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
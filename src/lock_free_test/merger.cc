@@ -0,0 +1,98 @@
+#include "../shm_bbuffer_spmc.h"
+#include "../shm_merge_sequencer.h"
+#include "data.h"
+
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+// feed handlers write their own buffers, the merged stream uses the same type as consumer.cc
+using InputProducer = shm_spmc::PShmBBufferLockFree<KLineData, /* IsProducer = */ true>;
+using InputConsumer = shm_spmc::PShmBBufferLockFree<KLineData, /* IsProducer = */ false>;
+using OutputProducer = shm_spmc::PShmBBufferGiacomoni<KLineData, /* IsProducer = */ true>;
+
+struct KLineTime {
+    int64_t operator()(const KLineData &kline) const { return kline.time; }
+};
+
+// Feed handler `id` of `num_feeds` publishes the symbols k with k % num_feeds == id, with some
+// jitter so the feeds don't run in lockstep.
+void run_feed(InputProducer &shm_buffer, int id, int num_feeds, int sym_cnt) {
+    std::mt19937 gen(12345 + id);
+    std::uniform_int_distribution<int> dis(0, 20);
+    KLineData data;
+
+    for (int t = 9'30'00'000; t <= 16'00'00'000; t += 3'000) {
+        if (t / 1'00'000 % 100 >= 60) {
+            t += 40'00'000 - 3'000;
+            continue;
+        }
+        for (int k = 1 + id; k <= sym_cnt; k += num_feeds) {
+            int rand = dis(gen);
+            data = {(uint32_t)k, t, (uint32_t)(k + rand), (uint32_t)rand, k + (rand & 5),
+                    k + (rand & 3), k + (rand & 13), k - (rand & 7)};
+            if (!shm_buffer.produce(data)) {
+                printf("feed %d: max size reached!\n", id);
+                fflush(stdout);
+                return;
+            }
+        }
+        if (dis(gen) == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 6) {
+        printf("Usage: %s <shm_name> <size_gb> <sym_cnt> <num_feeds> <window>\n", argv[0]);
+        return -1;
+    }
+
+    const char *shm_name = argv[1];
+    double size_gb = std::atof(argv[2]);
+    const int sym_cnt = std::atoi(argv[3]);
+    const int num_feeds = std::atoi(argv[4]);
+    const int64_t window = std::atoll(argv[5]);
+    printf("shm_name: %s\nsym_cnt: %d\nnum_feeds: %d\nwindow: %ld\n", shm_name, sym_cnt,
+           num_feeds, window);
+
+    constexpr size_t GB = 1024 * 1024 * 1024;
+    const size_t max_cap = size_gb * GB / sizeof(KLineData);
+
+    std::vector<std::string> feed_names;
+    std::vector<std::unique_ptr<InputProducer>> feeds;
+    std::vector<std::unique_ptr<InputConsumer>> inputs;
+    std::vector<InputConsumer *> input_ptrs;
+    for (int i = 0; i < num_feeds; i++) {
+        feed_names.push_back(std::string(shm_name) + ".feed" + std::to_string(i));
+        feeds.push_back(std::make_unique<InputProducer>(feed_names[i].c_str(),
+                                                        max_cap / num_feeds + 1));
+        inputs.push_back(std::make_unique<InputConsumer>(feed_names[i].c_str()));
+        input_ptrs.push_back(inputs[i].get());
+    }
+
+    OutputProducer output(shm_name, max_cap);
+    shm_spmc::MergeSequencer<KLineData, InputConsumer, OutputProducer, KLineTime> sequencer(
+        input_ptrs, output, window);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_feeds; i++) {
+        threads.emplace_back([&, i] {
+            run_feed(*feeds[i], i, num_feeds, sym_cnt);
+            feeds[i].reset();  // marks the feed as finished
+        });
+    }
+    sequencer.run();
+    for (auto &t : threads)
+        t.join();
+
+    for (const auto &name : feed_names)
+        shm_unlink(name.c_str());
+    printf("merged items: %lu\nlate items: %lu\n", sequencer.emitted_items(),
+           sequencer.late_items());
+    return 0;
+}
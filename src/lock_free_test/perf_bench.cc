@@ -0,0 +1,250 @@
+// Measures hardware counters per item of produce() and consume() loops, for each buffer type,
+// with a producer thread and `num_consumers` busy-polling consumer threads in this process.
+// `perf_bench_uncached` is the same program built with SHM_SPMC_CACHED_TAIL=0, so lock-free
+// consumers load the producer's tail on every consume() instead of caching it.
+#include "../shm_bbuffer_spmc.h"
+#include "../shm_segmented_log.h"
+#include "../shm_symbol_index.h"
+#include "../shm_compressed_log.h"
+#include "../perf_counters.h"
+#include "data.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using shm_spmc::idx_t;
+using shm_spmc::PerfCounters;
+using shm_spmc::PerfEventSpec;
+using Clock = std::chrono::steady_clock;
+
+struct BenchConfig {
+    idx_t num_items;
+    int num_consumers;
+    std::vector<int> cpus;  // producer first, then consumers, empty = no pinning
+    std::vector<PerfEventSpec> extra_events;
+};
+
+struct ThreadResult {
+    std::string role;
+    std::vector<double> counts;
+    idx_t items = 0;
+    double secs = 0;
+};
+
+void pin_thread(const BenchConfig &config, size_t thread_no) {
+    if (config.cpus.empty())
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(config.cpus[thread_no % config.cpus.size()], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof set, &set) != 0)
+        fprintf(stderr, "failed to pin thread %zu\n", thread_no);
+}
+
+// Removes the shared memory objects of a run, including the keyframe table of a
+// PShmCompressedLog and every segment of a PShmSegmentedLog. Reclaimed segments leave gaps in
+// the numbering, so this lists /dev/shm instead of stopping at the first missing one.
+void unlink_shm(const std::string &shm_name) {
+    shm_unlink(shm_name.c_str());
+    const std::string prefix = shm_name.substr(1) + ".";
+    DIR *dir = opendir("/dev/shm");
+    if (dir == nullptr)
+        return;
+    while (const dirent *entry = readdir(dir)) {
+        if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0)
+            shm_unlink(("/" + std::string(entry->d_name)).c_str());
+    }
+    closedir(dir);
+}
+
+void print_results(const char *type, const std::vector<std::string> &names,
+                   const std::vector<ThreadResult> &results) {
+    printf("%-11s %-11s", "buffer", "thread");
+    for (const std::string &name : names)
+        printf(" %11s", (name + "/it").c_str());
+    printf(" %11s\n", "ns/it");
+    for (const ThreadResult &r : results) {
+        printf("%-11s %-11s", type, r.role.c_str());
+        for (double count : r.counts) {
+            if (std::isnan(count))
+                printf(" %11s", "n/a");
+            else
+                printf(" %11.3f", count / r.items);
+        }
+        printf(" %11.3f\n", r.secs * 1e9 / r.items);
+    }
+    fflush(stdout);
+}
+
+// `make_producer` creates the buffer, then every consumer attaches before anyone starts
+// returns false, without printing results, if not every item got through
+template <typename Producer, typename Consumer>
+bool run_bench(const char *type, const BenchConfig &config,
+               std::function<std::unique_ptr<Producer>(const char *)> make_producer) {
+    const std::string shm_name = std::string("/perf_bench_") + type;
+    unlink_shm(shm_name);
+
+    std::unique_ptr<Producer> producer = make_producer(shm_name.c_str());
+    std::vector<std::unique_ptr<Consumer>> consumers;
+    for (int i = 0; i < config.num_consumers; i++)
+        consumers.push_back(std::make_unique<Consumer>(shm_name.c_str()));
+
+    std::vector<ThreadResult> results(1 + config.num_consumers);
+    std::vector<std::string> names;
+    std::atomic<int> ready{0};
+    const int num_threads = 1 + config.num_consumers;
+
+    // every thread opens its own counters, which only count the calling thread
+    auto measure = [&](size_t thread_no, const std::function<idx_t()> &loop) {
+        pin_thread(config, thread_no);
+        PerfCounters counters(config.extra_events);
+        if (thread_no == 0)
+            names = counters.names();
+        ready++;
+        while (ready.load() != num_threads) {
+        }
+        counters.start();
+        auto start = Clock::now();
+        idx_t items = loop();
+        results[thread_no].secs = std::chrono::duration<double>(Clock::now() - start).count();
+        counters.stop();
+        results[thread_no].counts = counters.read();
+        results[thread_no].items = items;
+    };
+
+    std::vector<std::thread> threads;
+    threads.emplace_back(measure, 0, [&]() {
+        KLineData item{};
+        for (idx_t i = 0; i < config.num_items; i++) {
+            item.sym_id = i % 7000 + 1;
+            item.time = i / 7000;
+            item.close = i % 7000;
+            if (!producer->produce(item)) {
+                fprintf(stderr, "%s: buffer is full\n", type);
+                return i;
+            }
+        }
+        return config.num_items;
+    });
+    results[0].role = "producer";
+    for (int c = 0; c < config.num_consumers; c++) {
+        results[1 + c].role = "consumer_" + std::to_string(c + 1);
+        threads.emplace_back(measure, 1 + c, [&, c]() {
+            KLineData item;
+            idx_t items = 0;
+            int rc;
+            while ((rc = consumers[c]->consume(item)) != CONSUME_FINISHED)
+                items += rc == CONSUME_SUCCESS;
+            return items;
+        });
+    }
+
+    // the producer finishes the buffer in its dtor
+    threads[0].join();
+    producer.reset();
+    for (size_t i = 1; i < threads.size(); i++)
+        threads[i].join();
+    consumers.clear();
+    unlink_shm(shm_name);
+
+    bool ok = results[0].items == config.num_items;
+    if (!ok)
+        fprintf(stderr, "%s: produced %lu of %lu items\n", type, results[0].items,
+                config.num_items);
+    for (int c = 0; c < config.num_consumers; c++) {
+        if (results[1 + c].items != results[0].items) {
+            fprintf(stderr, "%s: consumer %d got %lu of %lu items\n", type, c + 1,
+                    results[1 + c].items, results[0].items);
+            ok = false;
+        }
+    }
+    if (ok)
+        print_results(type, names, results);
+    return ok;
+}
+
+template <template <typename, bool> class Buffer>
+bool run_simple(const char *type, const BenchConfig &config) {
+    return run_bench<Buffer<KLineData, true>, Buffer<KLineData, false>>(
+        type, config, [&config](const char *shm_name) {
+            return std::make_unique<Buffer<KLineData, true>>(shm_name, config.num_items);
+        });
+}
+
+std::vector<int> parse_cpus(const std::string &arg) {
+    std::vector<int> cpus;
+    if (arg == "-")
+        return cpus;
+    for (size_t pos = 0; pos < arg.size();) {
+        size_t comma = std::min(arg.find(',', pos), arg.size());
+        cpus.push_back(std::stoi(arg.substr(pos, comma - pos)));
+        pos = comma + 1;
+    }
+    return cpus;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <lockfree|giacomoni|segmented|symindexed|compressed|all> "
+               "[num_items = 10000000] [num_consumers = 1] [cpu_list|-] [raw_event ...]\n",
+               argv[0]);
+        printf("  cpu_list: e.g. 0,2,4 pins the producer to cpu 0 and the consumers to 2 and 4\n");
+        printf("  raw_event: name=0x<config>, e.g. xsnp_hitm=0x4d2 on Intel Skylake and later\n");
+        return -1;
+    }
+
+    const std::string type = argv[1];
+    BenchConfig config;
+    config.num_items = argc > 2 ? std::atol(argv[2]) : 10'000'000;
+    config.num_consumers = argc > 3 ? std::atoi(argv[3]) : 1;
+    config.cpus = parse_cpus(argc > 4 ? argv[4] : "-");
+    for (int i = 5; i < argc; i++) {
+        PerfEventSpec event;
+        if (!PerfCounters::parse_raw_event(argv[i], event)) {
+            fprintf(stderr, "invalid raw event: %s\n", argv[i]);
+            return -1;
+        }
+        config.extra_events.push_back(event);
+    }
+
+    PerfCounters probe(config.extra_events);
+    printf("num_items: %lu\nnum_consumers: %d\ncached tail: %d\ncounted events: %zu of %zu\n",
+           config.num_items, config.num_consumers, SHM_SPMC_CACHED_TAIL, probe.num_counted(),
+           probe.names().size());
+    if (probe.num_counted() < probe.names().size())
+        printf("(n/a: not supported here, see /proc/sys/kernel/perf_event_paranoid)\n");
+
+    bool all = type == "all";
+    bool ok = true;
+    if (all || type == "lockfree")
+        ok &= run_simple<shm_spmc::PShmBBufferLockFree>("lockfree", config);
+    if (all || type == "giacomoni")
+        ok &= run_simple<shm_spmc::PShmBBufferGiacomoni>("giacomoni", config);
+    if (all || type == "symindexed")
+        ok &= run_simple<shm_spmc::PShmBBufferSymIndexed>("symindexed", config);
+    if (all || type == "compressed")
+        ok &= run_simple<shm_spmc::PShmCompressedLog>("compressed", config);
+    if (all || type == "segmented") {
+        // 4 segments, and no segment is reclaimed before every consumer has registered
+        using Producer = shm_spmc::PShmSegmentedLog<KLineData, true>;
+        using Consumer = shm_spmc::PShmSegmentedLog<KLineData, false>;
+        ok &= run_bench<Producer, Consumer>("segmented", config, [&config](const char *shm_name) {
+            return std::make_unique<Producer>(shm_name, config.num_items / 4 + 1,
+                                              config.num_consumers);
+        });
+    }
+    return ok ? 0 : 1;
+}
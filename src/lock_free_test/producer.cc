@@ -1,15 +1,60 @@
 #include "../shm_bbuffer_spmc.h"
+#include "../shm_segmented_log.h"
+#include "../shm_last_value_cache.h"
+#include "../shm_symbol_index.h"
+#include "../shm_time_index.h"
+#include "../shm_compressed_log.h"
 #include "data.h"
 
+#include <memory>
 #include <random>
+#include <type_traits>
+#include <vector>
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
 
 template <typename T>
 // using ShmProducer = shm_spmc::PShmBBufferLockFree<T, /* IsProducer = */ true>;
+// using ShmProducer = shm_spmc::PShmSegmentedLog<T, /* IsProducer = */ true>;
+// using ShmProducer = shm_spmc::PShmBBufferSymIndexed<T, /* IsProducer = */ true>;
+// using ShmProducer = shm_spmc::PShmCompressedLog<T, /* IsProducer = */ true>;
 using ShmProducer = shm_spmc::PShmBBufferGiacomoni<T, /* IsProducer = */ true>;
 
+template <typename T>
+using ShmLastValueCache = shm_spmc::PShmLastValueCache<T, /* IsProducer = */ true>;
+
+using ShmTimeIndex = shm_spmc::PShmTimeIndex</* IsProducer = */ true>;
+
+// only a segmented log reclaims what consumers may not have read yet, so only it takes
+// `min_consumers`, the # of consumers to retain the whole log for until they have attached
+template <typename T>
+std::unique_ptr<ShmProducer<T>> make_producer(const char *shm_name, shm_spmc::idx_t capacity,
+                                              shm_spmc::idx_t min_consumers) {
+    if constexpr (std::is_same_v<ShmProducer<T>, shm_spmc::PShmSegmentedLog<T, true>>)
+        return std::make_unique<ShmProducer<T>>(shm_name, capacity, min_consumers);
+    else
+        return std::make_unique<ShmProducer<T>>(shm_name, capacity);
+}
+
+// produce_data() publishes a timestep every 3s from 9:30 to 16:00, times are HHMMSSmmm
+constexpr int kStartTime = 9'30'00'000;
+constexpr int kEndTime = 16'00'00'000;
+constexpr int kDeltaTime = 3'000;
+
+// skips minutes 60-99 to the next hour
+constexpr int skip_to_valid(int t) { return t / 1'00'000 % 100 >= 60 ? t + 40'00'000 : t; }
+
+constexpr int next_time(int t) { return skip_to_valid(t + kDeltaTime); }
+
+// # of timesteps produce_data() publishes
+constexpr shm_spmc::idx_t num_timesteps() {
+    shm_spmc::idx_t n = 0;
+    for (int t = kStartTime; t <= kEndTime; t = next_time(t))
+        n++;
+    return n;
+}
+
 std::random_device rd;
 std::mt19937 gen(rd());
 std::uniform_int_distribution<int> dis(0, 20);
@@ -27,56 +72,98 @@ void fill_data(KLineData &data, int k, int t) {
     data.close = k + (rand & 3);
 }
 
-void produce_data(ShmProducer<KLineData> &shm_buffer, int sym_cnt) {
+void produce_data(ShmProducer<KLineData> &shm_buffer, ShmLastValueCache<KLineData> *lvc,
+                  ShmTimeIndex *time_index, int sym_cnt, bool bulk) {
     gen.seed(12345);  // set seed for reproducibility
     KLineData data;
+    std::vector<KLineData> batch(bulk ? sym_cnt : 0);
+    shm_spmc::idx_t produced = 0;
 
     constexpr int delta_print_time = 10'00'000;  // every 10 min
-    int print_time = 9'30'00'000;
-    int t = 9'30'00'000;
-    int delta_t = 3'000;
-
-    while (t <= 16'00'00'000) {
-        if (t / 1'00'000 % 100 >= 60) {
-            t += 40'00'000;
-            print_time += 40'00'000;
-            continue;
-        }
+    int print_time = kStartTime;
+
+    for (int t = kStartTime; t <= kEndTime; t = next_time(t)) {
         if (t >= print_time) {
             printf("producer current timepoint: %d\n", t);
             fflush(stdout);
-            print_time += delta_print_time;
+            print_time = skip_to_valid(print_time + delta_print_time);
         }
 
-        for (int k = 1; k <= sym_cnt; k++) {
-            fill_data(data, k, t);
-            if (!shm_buffer.produce(data)) {
+        if (bulk) {
+            // publish a whole timestep at once
+            for (int k = 1; k <= sym_cnt; k++)
+                fill_data(batch[k - 1], k, t);
+            shm_spmc::idx_t n = shm_buffer.produce_bulk(batch.data(), sym_cnt);
+            // only once they are in the log, so LVC readers never see values the log doesn't hold
+            if (lvc) {
+                for (shm_spmc::idx_t i = 0; i < n; i++)
+                    lvc->update(batch[i].sym_id, batch[i]);
+            }
+            if (n != (shm_spmc::idx_t)sym_cnt) {
                 printf("Failed to produce data: max size reached!\n");
                 fflush(stdout);
                 return;
             }
+            if (time_index)
+                time_index->on_record(t, produced);
+            produced += sym_cnt;
+        } else {
+            for (int k = 1; k <= sym_cnt; k++) {
+                fill_data(data, k, t);
+                if (!shm_buffer.produce(data)) {
+                    printf("Failed to produce data: max size reached!\n");
+                    fflush(stdout);
+                    return;
+                }
+                if (lvc)
+                    lvc->update(k, data);
+                if (time_index)
+                    time_index->on_record(t, produced);
+                produced++;
+            }
         }
-
-        t += delta_t;
     }
 }
 
 int main(int argc, char *argv[]) {
     if (argc < 4) {
-        printf("Usage: %s <shm_name> <size_gb> <sym_cnt>\n", argv[0]);
+        printf("Usage: %s <shm_name> <size_gb> <sym_cnt> [memcpy|nt|bulk|nt_bulk] [lvc_shm_name|-] "
+               "[tidx_shm_name|-] [min_consumers = 0]\n",
+               argv[0]);
         return -1;
     }
 
     const char *shm_name = argv[1];
     double size_gb = std::atof(argv[2]);
     const int sym_cnt = std::atoi(argv[3]);
-    printf("shm_name: %s\nsym_cnt: %d\n", shm_name, sym_cnt);
+    // nt: non-temporal stores, bulk: publish a whole timestep at once
+    const char *store_mode = argc > 4 ? argv[4] : "memcpy";
+    // consumers started after the producer, e.g. by launch_spmc.sh, would miss the segments
+    // reclaimed before they attached
+    const int min_consumers = argc > 7 ? std::atoi(argv[7]) : 0;
+    printf("shm_name: %s\nsym_cnt: %d\nstore_mode: %s\nmin_consumers: %d\n", shm_name, sym_cnt,
+           store_mode, min_consumers);
 
     constexpr size_t GB = 1024 * 1024 * 1024;
     const size_t max_cap = size_gb * GB / sizeof(KLineData);
-    ShmProducer<KLineData> shm_buffer(shm_name, max_cap);
+    std::unique_ptr<ShmProducer<KLineData>> shm_buffer =
+        make_producer<KLineData>(shm_name, max_cap, min_consumers);
+    shm_buffer->set_streaming_stores(strstr(store_mode, "nt") != nullptr);
+
+    // optionally keep the latest kline per symbol alongside the log, sym_id is in [1, sym_cnt]
+    std::unique_ptr<ShmLastValueCache<KLineData>> lvc;
+    if (argc > 5 && strcmp(argv[5], "-") != 0)
+        lvc = std::make_unique<ShmLastValueCache<KLineData>>(argv[5], sym_cnt + 1);
+
+    // optionally index the first record of every timestep, so consumers can seek by time
+    // at most one entry per timestep of produce_data(), a compressed log may hold more records
+    // than `max_cap`
+    std::unique_ptr<ShmTimeIndex> time_index;
+    if (argc > 6 && strcmp(argv[6], "-") != 0)
+        time_index = std::make_unique<ShmTimeIndex>(argv[6], num_timesteps());
 
-    produce_data(shm_buffer, sym_cnt);
+    produce_data(*shm_buffer, lvc.get(), time_index.get(), sym_cnt,
+                 strstr(store_mode, "bulk") != nullptr);
 
     return 0;
 }
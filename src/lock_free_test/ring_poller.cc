@@ -0,0 +1,124 @@
+// One consumer thread services `num_rings` buffers with a RingPoller: feed threads publish
+// their shard of the symbols (k % num_rings) to their own ring one timestep at a time and ring a
+// shared doorbell, while the consumer sleeps on the doorbell whenever all rings are empty.
+#include "../shm_bbuffer_spmc.h"
+#include "../shm_ring_poller.h"
+#include "data.h"
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using ShmProducer = shm_spmc::PShmBBufferLockFree<KLineData, /* IsProducer = */ true>;
+using ShmConsumer = shm_spmc::PShmBBufferLockFree<KLineData, /* IsProducer = */ false>;
+using Clock = std::chrono::steady_clock;
+
+void run_feed(std::unique_ptr<ShmProducer> shm_buffer, shm_spmc::PShmDoorbell &doorbell, int id,
+              int num_rings, int sym_cnt) {
+    std::mt19937 gen(12345 + id);
+    std::uniform_int_distribution<int> dis(0, 20);
+    std::vector<KLineData> batch;
+
+    for (int t = 9'30'00'000; t <= 16'00'00'000; t += 3'000) {
+        if (t / 1'00'000 % 100 >= 60) {
+            t += 40'00'000 - 3'000;
+            continue;
+        }
+        batch.clear();
+        for (int k = 1 + id; k <= sym_cnt; k += num_rings) {
+            int rand = dis(gen);
+            batch.push_back({(uint32_t)k, t, (uint32_t)(k + rand), (uint32_t)rand,
+                             k + (rand & 5), k + (rand & 3), k + (rand & 13), k - (rand & 7)});
+        }
+        if (shm_buffer->produce_bulk(batch.data(), batch.size()) != batch.size()) {
+            printf("feed %d: max size reached!\n", id);
+            break;
+        }
+        doorbell.ring();
+        // leave the rings idle now and then, so the consumer gets to sleep
+        if (dis(gen) < 2)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    // finishes the ring, then wakes the consumer so it notices
+    shm_buffer.reset();
+    doorbell.ring();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s <shm_name> <sym_cnt> <num_rings> [rr|priority] [spin = 100]\n", argv[0]);
+        printf("  priority: ring 0 is served before the others\n");
+        return -1;
+    }
+
+    const char *shm_name = argv[1];
+    const int sym_cnt = std::atoi(argv[2]);
+    const int num_rings = std::atoi(argv[3]);
+    const bool priority = argc > 4 && strcmp(argv[4], "priority") == 0;
+    const int spin = argc > 5 ? std::atoi(argv[5]) : 100;
+    printf("shm_name: %s\nsym_cnt: %d\nnum_rings: %d\npolicy: %s\nspin: %d\n", shm_name, sym_cnt,
+           num_rings, priority ? "priority" : "round-robin", spin);
+
+    const std::string doorbell_name = std::string(shm_name) + ".doorbell";
+    shm_spmc::PShmDoorbell doorbell(doorbell_name.c_str(), /* create = */ true);
+
+    // a day has 13001 timesteps
+    const shm_spmc::idx_t ring_cap = (sym_cnt / num_rings + 1) * 13'001;
+    std::vector<std::unique_ptr<ShmProducer>> producers;
+    std::vector<std::unique_ptr<ShmConsumer>> consumers;
+    shm_spmc::RingPoller<KLineData, ShmConsumer> poller(
+        priority ? shm_spmc::PollPolicy::PRIORITY : shm_spmc::PollPolicy::ROUND_ROBIN);
+    for (int i = 0; i < num_rings; i++) {
+        std::string ring_name = std::string(shm_name) + ".ring." + std::to_string(i);
+        producers.push_back(std::make_unique<ShmProducer>(ring_name.c_str(), ring_cap));
+        consumers.push_back(std::make_unique<ShmConsumer>(ring_name.c_str()));
+        poller.add(consumers.back().get(), i == 0 ? 1 : 0);
+    }
+
+    auto start = Clock::now();
+    std::vector<std::thread> feeds;
+    for (int i = 0; i < num_rings; i++)
+        feeds.emplace_back(run_feed, std::move(producers[i]), std::ref(doorbell), i, num_rings,
+                           sym_cnt);
+
+    std::vector<uint64_t> items(num_rings, 0);
+    std::vector<int32_t> last_time(num_rings, 0);
+    uint64_t out_of_order = 0, timeouts = 0;
+    KLineData kline;
+    size_t ring;
+    int rc;
+    while ((rc = poller.wait(kline, ring, &doorbell, std::chrono::milliseconds(100), spin)) !=
+           CONSUME_FINISHED) {
+        if (rc == CONSUME_AGAIN) {
+            timeouts++;
+            continue;
+        }
+        items[ring]++;
+        if (kline.time < last_time[ring] || (int)((kline.sym_id - 1) % num_rings) != (int)ring)
+            out_of_order++;
+        last_time[ring] = kline.time;
+    }
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (std::thread &feed : feeds)
+        feed.join();
+    consumers.clear();
+    for (int i = 0; i < num_rings; i++)
+        shm_unlink((std::string(shm_name) + ".ring." + std::to_string(i)).c_str());
+    shm_unlink(doorbell_name.c_str());
+
+    uint64_t total = 0;
+    for (int i = 0; i < num_rings; i++) {
+        printf("ring %d: %lu items\n", i, items[i]);
+        total += items[i];
+    }
+    printf("total: %lu items in %.3fs, out of order: %lu, timeouts: %lu\n", total, secs,
+           out_of_order, timeouts);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace shm_spmc {
+
+struct PerfEventSpec {
+    std::string name;
+    uint32_t type;
+    uint64_t config;
+};
+
+// Hardware counters of the calling thread (user space only) via perf_event_open(2), read as
+// one group so all events cover the same instructions.
+//
+// Counts cycles, instructions, L1d and LLC load misses and the task clock, plus any `extra`
+// events, e.g. model-specific raw events for cache-line transfers between cores (see
+// parse_raw_event()). Events the kernel or CPU can't count (no PMU in a VM, perf_event_paranoid
+// too high) are skipped and read as NaN.
+class PerfCounters {
+public:
+    explicit PerfCounters(const std::vector<PerfEventSpec> &extra = {}) {
+        auto cache_event = [](uint64_t cache, uint64_t result) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+        };
+        std::vector<PerfEventSpec> events = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instr", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"L1d-miss", PERF_TYPE_HW_CACHE,
+             cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"LLC-miss", PERF_TYPE_HW_CACHE,
+             cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"task-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+        };
+        events.insert(events.end(), extra.begin(), extra.end());
+
+        for (size_t i = 0; i < events.size(); i++) {
+            names_.push_back(events[i].name);
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof attr);
+            attr.size = sizeof attr;
+            attr.type = events[i].type;
+            attr.config = events[i].config;
+            attr.disabled = leader_ == -1;  // the leader starts and stops the whole group
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0);
+            if (fd == -1)
+                continue;
+            if (leader_ == -1)
+                leader_ = fd;
+            fds_.push_back(fd);
+            slots_.push_back(i);
+        }
+    }
+
+    ~PerfCounters() {
+        for (int fd : fds_)
+            close(fd);
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    void start() {
+        if (leader_ == -1)
+            return;
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    void stop() {
+        if (leader_ != -1)
+            ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    // Returns the counts since start(), in the order of names(), scaled up if the kernel had
+    // to multiplex the group. NaN for events that aren't counted.
+    std::vector<double> read() const {
+        std::vector<double> values(names_.size(), NAN);
+        if (leader_ == -1)
+            return values;
+
+        // nr, time_enabled, time_running, value...
+        std::vector<uint64_t> buf(3 + fds_.size());
+        if (::read(leader_, buf.data(), buf.size() * sizeof buf[0]) == -1 || buf[2] == 0)
+            return values;
+        double scale = (double)buf[1] / buf[2];
+        for (size_t i = 0; i < buf[0] && i < slots_.size(); i++)
+            values[slots_[i]] = buf[3 + i] * scale;
+        return values;
+    }
+
+    const std::vector<std::string> &names() const { return names_; }
+
+    // # of events that are counted
+    size_t num_counted() const { return fds_.size(); }
+
+    // Parses a raw PMU event "name=0x<config>", e.g. on Intel Skylake and later
+    // "xsnp_hitm=0x4d2" (MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM, loads that hit a line modified in
+    // another core) or "rfo_miss=0x2224" (L2_RQSTS.RFO_MISS, stores that had to fetch the line
+    // for ownership). See `perf list --details` for the codes of other CPUs.
+    static bool parse_raw_event(const char *spec, PerfEventSpec &event) {
+        const char *eq = strchr(spec, '=');
+        if (eq == nullptr || eq == spec)
+            return false;
+        char *end;
+        uint64_t config = strtoull(eq + 1, &end, 0);
+        if (*end != '\0' || end == eq + 1)
+            return false;
+        event = {std::string(spec, eq), PERF_TYPE_RAW, config};
+        return true;
+    }
+
+private:
+    std::vector<std::string> names_;
+    std::vector<int> fds_;
+    std::vector<size_t> slots_;  // index into names_ of every fd, in group order
+    int leader_ = -1;
+};
+
+}  // namespace shm_spmc
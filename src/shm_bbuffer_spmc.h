@@ -1,15 +1,21 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <new>
 #include <string>
 #include <type_traits>
 #include <cassert>
 #include <cctype>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
 #include <fcntl.h>
 #include <semaphore.h>
 #include <sys/mman.h>
@@ -33,6 +39,17 @@
 #define load_fence()
 #endif
 
+#ifdef __x86_64__
+#define store_fence() asm volatile("sfence" ::: "memory")
+#elif __aarch64__
+#define store_fence() asm volatile("dmb ishst" ::: "memory")
+#else
+#define store_fence()
+#endif
+
+// read prefetch into all cache levels
+#define prefetch_read(addr) __builtin_prefetch((addr), 0, 3)
+
 #ifdef __cpp_lib_hardware_interference_size
 #define CACHELINE_ALIGNED alignas(std::hardware_destructive_interference_size)
 #else
@@ -44,10 +61,107 @@
 #define CONSUME_AGAIN 0
 #define CONSUME_FINISHED -1
 
+// PShmBBufferLockFree consumers cache the producer's tail, 0 loads it on every consume(), e.g.
+// to compare both with `perf_bench`
+#ifndef SHM_SPMC_CACHED_TAIL
+#define SHM_SPMC_CACHED_TAIL 1
+#endif
+
 namespace shm_spmc {
 
 typedef unsigned long idx_t;
 
+// Copies `n` bytes using non-temporal (streaming) stores, which write around the cache instead
+// of reading each destination line in with an RFO first. Falls back to memcpy() if `dst` or `n`
+// are not suitably aligned. Streaming stores are weakly ordered, so call store_fence() before
+// publishing the data to other threads.
+inline void stream_copy(void *dst, const void *src, size_t n) {
+#if defined(__x86_64__)
+    if ((reinterpret_cast<uintptr_t>(dst) & 15) == 0 && n % 16 == 0) {
+        auto *d = static_cast<__m128i *>(dst);
+        auto *s = static_cast<const __m128i *>(src);
+        for (size_t i = 0; i < n / 16; i++)
+            _mm_stream_si128(&d[i], _mm_loadu_si128(&s[i]));
+        return;
+    }
+    if ((reinterpret_cast<uintptr_t>(dst) & 3) == 0 && n % 4 == 0) {
+        auto *d = static_cast<int *>(dst);
+        auto *s = static_cast<const char *>(src);
+        for (size_t i = 0; i < n / 4; i++) {
+            int v;
+            memcpy(&v, s + i * 4, sizeof v);
+            _mm_stream_si32(&d[i], v);
+        }
+        return;
+    }
+#elif defined(__aarch64__)
+    if ((reinterpret_cast<uintptr_t>(dst) & 15) == 0 && n % 16 == 0) {
+        auto *d = static_cast<char *>(dst);
+        auto *s = static_cast<const char *>(src);
+        for (size_t i = 0; i < n; i += 16) {
+            uint64_t lo, hi;
+            memcpy(&lo, s + i, sizeof lo);
+            memcpy(&hi, s + i + 8, sizeof hi);
+            asm volatile("stnp %x0, %x1, [%2]" ::"r"(lo), "r"(hi), "r"(d + i) : "memory");
+        }
+        return;
+    }
+#endif
+    memcpy(dst, src, n);
+}
+
+// A producer creates its shared memory object as `<shm_name>.init` and publish_shm_object()s it
+// under `shm_name` once the control block is initialized. So a consumer, or a script waiting for
+// the name to appear like launch_pipeline.sh, never maps an object that isn't sized or whose
+// capacity is still 0. The rename relies on POSIX shared memory objects being files in /dev/shm,
+// as on Linux.
+inline std::string shm_init_name(const char *shm_name) { return std::string(shm_name) + ".init"; }
+
+inline int create_shm_object(const char *shm_name) {
+    std::string init_name = shm_init_name(shm_name);
+    // left over by a producer that died while initializing
+    shm_unlink(init_name.c_str());
+    return shm_open(init_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+}
+
+// fails like shm_open(O_CREAT | O_EXCL) if `shm_name` already exists
+inline void publish_shm_object(const char *shm_name) {
+    std::string path = std::string("/dev/shm/") + (shm_name[0] == '/' ? shm_name + 1 : shm_name);
+    if (renameat2(AT_FDCWD, (path + ".init").c_str(), AT_FDCWD, path.c_str(), RENAME_NOREPLACE) ==
+        -1) {
+        shm_unlink(shm_init_name(shm_name).c_str());
+        handle_error("renameat2");
+    }
+}
+
+// Unmaps the pages of a mapped region that a process has moved past, in increasing address
+// order. This drops their page table entries and resident pages from the process, while the
+// shared memory object keeps the data for everyone else.
+class MappedRegionReleaser {
+public:
+    void reset(const void *begin) {
+        begin_ = reinterpret_cast<uintptr_t>(begin);
+        begin_ = (begin_ + page_size() - 1) & ~(page_size() - 1);
+    }
+
+    // unmaps the whole pages in [begin, end)
+    void release_until(const void *end) {
+        uintptr_t e = reinterpret_cast<uintptr_t>(end) & ~(page_size() - 1);
+        if (e > begin_) {
+            munmap(reinterpret_cast<void *>(begin_), e - begin_);
+            begin_ = e;
+        }
+    }
+
+private:
+    static uintptr_t page_size() {
+        static const uintptr_t size = sysconf(_SC_PAGESIZE);
+        return size;
+    }
+
+    uintptr_t begin_ = 0;
+};
+
 struct ShmControlBlock {
     sem_t mutex;
     sem_t full;
@@ -127,7 +241,7 @@ public:
         static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
         int shm_fd = -1;
         if constexpr (IsProducer) {
-            shm_fd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+            shm_fd = create_shm_object(shm_name);
         } else {
             shm_fd = shm_open(shm_name, O_RDWR, 0600);
         }
@@ -149,6 +263,8 @@ public:
             handle_error("mmap");
 
         this->init_shm_meta(shmp, capacity);
+        if constexpr (IsProducer)
+            publish_shm_object(shm_name);
     }
 
     ~PShmCircularBuffer() {
@@ -239,7 +355,7 @@ public:
         static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
 
         if constexpr (IsProducer) {
-            shm_fd_ = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+            shm_fd_ = create_shm_object(shm_name);
         } else {
             shm_fd_ = shm_open(shm_name, O_RDONLY, 0600);
         }
@@ -269,6 +385,7 @@ public:
             // ftruncate() already zeroed the memory, here for clarity
             cb_->tail_.store(0, std::memory_order_relaxed);
             cb_->writer_finished_ = false;
+            publish_shm_object(shm_name);
         } else {
             // consumers can close fd after mmap, the producer keeps it open for ftruncate in dtor
             close(shm_fd_);
@@ -300,11 +417,39 @@ public:
         if (tail == cb_->cap_)
             return false;
 
-        memcpy(&buffer_[tail], &item, sizeof item);
+        if (streaming_stores_) {
+            stream_copy(&buffer_[tail], &item, sizeof item);
+            store_fence();
+        } else {
+            memcpy(&buffer_[tail], &item, sizeof item);
+        }
         cb_->tail_.store(tail + 1, std::memory_order_release);
+        if (unlikely(tail + 1 >= next_release_))
+            release_behind(tail + 1);
         return true;
     }
 
+    // producer appends up to `n` items to the buffer tail and publishes them at once
+    // returns the # of items appended, which is less than `n` if the buffer gets full
+    idx_t produce_bulk(const T *items, idx_t n) {
+        static_assert(IsProducer, "can only be called from producers");
+
+        idx_t tail = cb_->tail_.load(std::memory_order_relaxed);
+        if (n > cb_->cap_ - tail)
+            n = cb_->cap_ - tail;
+
+        if (streaming_stores_) {
+            stream_copy(&buffer_[tail], items, sizeof *items * n);
+            store_fence();
+        } else {
+            memcpy(&buffer_[tail], items, sizeof *items * n);
+        }
+        cb_->tail_.store(tail + n, std::memory_order_release);
+        if (unlikely(tail + n >= next_release_))
+            release_behind(tail + n);
+        return n;
+    }
+
     // consumer retrieves an item from the buffer head
     int consume(T &item) {
         static_assert(!IsProducer, "can only be called from consumers");
@@ -314,7 +459,7 @@ public:
             if (cb_->tail_.load(std::memory_order_relaxed) == head_)
                 return CONSUME_FINISHED;
         } else {
-#if 1
+#if SHM_SPMC_CACHED_TAIL
             // If the reader is slower than the writer, caching the tail can significantly
             // reduce the # of loads of `tail_`, which the writer updates frequently.
             //
@@ -336,14 +481,92 @@ public:
 #endif
         }
 
+        // only prefetch published items, lines the producer is still writing would bounce
+        if (prefetch_dist_ != 0 && head_ + prefetch_dist_ < cached_tail_)
+            prefetch_read(&buffer_[head_ + prefetch_dist_]);
         memcpy(&item, &buffer_[head_], sizeof item);
         head_++;
+        if (unlikely(head_ >= next_release_))
+            release_behind(head_);
+        return CONSUME_SUCCESS;
+    }
+
+    // Consumer gets the published items at its head in place, without copying them: `items`
+    // points at the first one and `n` is set to their #, at most `max_n`. They stay valid
+    // until advance() moves the head past them.
+    // returns the same codes as consume()
+    int peek(const T *&items, idx_t &n, idx_t max_n) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        if (head_ == cached_tail_) {
+            bool finished = cb_->writer_finished_;
+            cached_tail_ = cb_->tail_.load(std::memory_order_acquire);
+            if (head_ == cached_tail_)
+                return finished ? CONSUME_FINISHED : CONSUME_AGAIN;
+        }
+        items = &buffer_[head_];
+        n = std::min(max_n, cached_tail_ - head_);
         return CONSUME_SUCCESS;
     }
 
+    // consumer moves its head past `n` items returned by peek()
+    void advance(idx_t n) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        assert(n <= cached_tail_ - head_);
+        head_ += n;
+        if (unlikely(head_ >= next_release_))
+            release_behind(head_);
+    }
+
     idx_t capacity() const { return cb_->cap_; }
 
+    // # of items published so far
+    idx_t size() const { return cb_->tail_.load(std::memory_order_acquire); }
+
+    // index of the consumer's next item
+    idx_t position() const { return head_; }
+
+    // Moves the consumer's head to `index`, e.g. one found in a PShmTimeIndex, so it doesn't
+    // have to read everything before. Clamped to the published tail. Don't seek back into the
+    // part of the buffer already unmapped by set_release_chunk().
+    void seek(idx_t index) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        cached_tail_ = cb_->tail_.load(std::memory_order_acquire);
+        head_ = std::min(index, cached_tail_);
+    }
+
+    // Unmaps the part of the buffer behind the head (consumers) or tail (the producer) every
+    // `chunk_bytes` bytes, 0 disables it. This keeps the RSS and page tables of long-running
+    // processes bounded by the chunk size instead of growing with the log.
+    void set_release_chunk(size_t chunk_bytes) {
+        release_chunk_ = chunk_bytes / sizeof(T);
+        idx_t pos = IsProducer ? cb_->tail_.load(std::memory_order_relaxed) : head_;
+        if (release_chunk_ == 0) {
+            next_release_ = ~idx_t(0);
+        } else {
+            releaser_.reset(buffer_);
+            next_release_ = pos + release_chunk_;
+        }
+    }
+
+    // The producer writes with non-temporal stores, so the items it never reads back don't
+    // evict its working set. Best combined with produce_bulk(), as every publish needs a fence.
+    void set_streaming_stores(bool enable) {
+        static_assert(IsProducer, "can only be called from producers");
+        streaming_stores_ = enable;
+    }
+
+    // The consumer prefetches the item `dist` items ahead of its head, 0 disables it.
+    void set_prefetch_distance(idx_t dist) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        prefetch_dist_ = dist;
+    }
+
 private:
+    void release_behind(idx_t pos) {
+        releaser_.release_until(&buffer_[pos]);
+        next_release_ = pos + release_chunk_;
+    }
+
     const std::string shm_name_;
     int shm_fd_;
 
@@ -351,6 +574,11 @@ private:
     T *buffer_;
     idx_t head_ = 0;
     idx_t cached_tail_ = 0;
+    idx_t prefetch_dist_ = 0;
+    bool streaming_stores_ = false;
+    idx_t release_chunk_ = 0;
+    idx_t next_release_ = ~idx_t(0);
+    MappedRegionReleaser releaser_;
 };
 
 struct ShmControlBlockGiacomoni {
@@ -367,7 +595,7 @@ public:
         static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
 
         if constexpr (IsProducer) {
-            shm_fd_ = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+            shm_fd_ = create_shm_object(shm_name);
         } else {
             shm_fd_ = shm_open(shm_name, O_RDONLY, 0600);
         }
@@ -395,6 +623,7 @@ public:
         if constexpr (IsProducer) {
             cb_->cap_ = capacity;
             cb_->writer_finished_ = false;
+            publish_shm_object(shm_name);
         } else {
             // consumers can close fd after mmap, the producer keeps it open for ftruncate in dtor
             close(shm_fd_);
@@ -424,12 +653,41 @@ public:
         if (tail_ == cb_->cap_)
             return false;
 
-        memcpy(&buffer_[tail_], &item, sizeof item);
+        if (streaming_stores_) {
+            stream_copy(&buffer_[tail_], &item, sizeof item);
+            store_fence();
+        } else {
+            memcpy(&buffer_[tail_], &item, sizeof item);
+        }
         produced_[tail_].store(true, std::memory_order_release);
         tail_++;
+        if (unlikely(tail_ >= next_release_))
+            release_behind(tail_);
         return true;
     }
 
+    // producer appends up to `n` items to the buffer tail
+    // returns the # of items appended, which is less than `n` if the buffer gets full
+    idx_t produce_bulk(const T *items, idx_t n) {
+        static_assert(IsProducer, "can only be called from producers");
+
+        if (n > cb_->cap_ - tail_)
+            n = cb_->cap_ - tail_;
+
+        if (streaming_stores_) {
+            stream_copy(&buffer_[tail_], items, sizeof *items * n);
+            store_fence();
+        } else {
+            memcpy(&buffer_[tail_], items, sizeof *items * n);
+        }
+        for (idx_t i = 0; i < n; i++)
+            produced_[tail_ + i].store(true, std::memory_order_release);
+        tail_ += n;
+        if (unlikely(tail_ >= next_release_))
+            release_behind(tail_);
+        return n;
+    }
+
     // consumer retrieves an item from the buffer head
     int consume(T &item) {
         static_assert(!IsProducer, "can only be called from consumers");
@@ -444,21 +702,63 @@ public:
                 return CONSUME_AGAIN;
         }
 
+        // see PShmBBufferLockFree::consume(), only prefetch published items
+        if (prefetch_dist_ != 0 && head_ + prefetch_dist_ < cb_->cap_ &&
+            produced_[head_ + prefetch_dist_].load(std::memory_order_relaxed))
+            prefetch_read(&buffer_[head_ + prefetch_dist_]);
         memcpy(&item, &buffer_[head_], sizeof item);
         head_++;
+        if (unlikely(head_ >= next_release_))
+            release_behind(head_);
         return CONSUME_SUCCESS;
     }
 
     idx_t capacity() const { return cb_->cap_; }
 
+    // index of the consumer's next item
+    idx_t position() const { return head_; }
+
+    // see PShmBBufferLockFree::seek(), clamped to the capacity
+    void seek(idx_t index) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        head_ = std::min(index, cb_->cap_);
+    }
+
+    // see PShmBBufferLockFree::set_release_chunk(), also releases the `produced_` flags
+    void set_release_chunk(size_t chunk_bytes) {
+        release_chunk_ = chunk_bytes / sizeof(T);
+        idx_t pos = IsProducer ? tail_ : head_;
+        if (release_chunk_ == 0) {
+            next_release_ = ~idx_t(0);
+        } else {
+            flags_releaser_.reset(produced_);
+            buffer_releaser_.reset(buffer_);
+            next_release_ = pos + release_chunk_;
+        }
+    }
+
+    // see PShmBBufferLockFree::set_streaming_stores()
+    void set_streaming_stores(bool enable) {
+        static_assert(IsProducer, "can only be called from producers");
+        streaming_stores_ = enable;
+    }
+
+    // see PShmBBufferLockFree::set_prefetch_distance()
+    void set_prefetch_distance(idx_t dist) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        prefetch_dist_ = dist;
+    }
+
 private:
     static idx_t round_up(idx_t n, idx_t alignment) {
         return ((n + alignment - 1) / alignment) * alignment;
     }
 
     static idx_t produced_len(idx_t cap) {
-        // one extra element is used as a sentinel to avoid a branch in consume()
-        return round_up(cap + 1, alignof(T));
+        // one extra element is used as a sentinel to avoid a branch in consume(), and `buffer_`
+        // starts on a cache line so streaming stores of whole items are 16-byte aligned
+        constexpr idx_t cb_size = sizeof(ShmControlBlockGiacomoni);
+        return round_up(cb_size + cap + 1, std::max<idx_t>(64, alignof(T))) - cb_size;
     }
 
     size_t get_shm_size(idx_t cap) const {
@@ -469,6 +769,12 @@ private:
         return sizeof *cb_ + sizeof *produced_ * produced_len(cap) + sizeof(T) * cnt;
     }
 
+    void release_behind(idx_t pos) {
+        flags_releaser_.release_until(&produced_[pos]);
+        buffer_releaser_.release_until(&buffer_[pos]);
+        next_release_ = pos + release_chunk_;
+    }
+
     const std::string shm_name_;
     int shm_fd_;
 
@@ -479,7 +785,13 @@ private:
     // align to cache lines to avoid false sharing if consumers and producers share
     // the same address space (e.g., as different threads of the same process)
     CACHELINE_ALIGNED idx_t head_ = 0;
+    idx_t prefetch_dist_ = 0;
     CACHELINE_ALIGNED idx_t tail_ = 0;
+    bool streaming_stores_ = false;
+    idx_t release_chunk_ = 0;
+    idx_t next_release_ = ~idx_t(0);
+    MappedRegionReleaser flags_releaser_;
+    MappedRegionReleaser buffer_releaser_;
 };
 
 }  // namespace shm_spmc
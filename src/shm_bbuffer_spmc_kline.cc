@@ -1,13 +1,22 @@
 #include "shm_bbuffer_spmc.h"
+#include "shm_segmented_log.h"
+#include "kline_aggregator.h"
 #include "kline_common.h"
 #include "websocketpp/config/asio_client.hpp"
+#include "websocketpp/config/asio_no_tls_client.hpp"
 #include "websocketpp/client.hpp"
 
 #include <iostream>
 #include <algorithm>
+#include <chrono>
 #include <csignal>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 using shm_spmc::idx_t;
+using shm_spmc::KlineBar;
 using shm_spmc::SVShmCircularBuffer;
 
 enum { MAX_KLINE_MSG_SIZE = 400 };
@@ -16,76 +25,200 @@ struct KlineData {
     char msg[MAX_KLINE_MSG_SIZE];
 };
 
-typedef websocketpp::client<websocketpp::config::asio_tls_client> WebSocketClient;
 typedef SVShmCircularBuffer<KlineData, /* IsProducer: */ true> SVShmProducer;
 typedef SVShmCircularBuffer<KlineData, /* IsProducer: */ false> SVShmConsumer;
+typedef shm_spmc::PShmSegmentedLog<KlineBar, /* IsProducer: */ true> BarProducer;
 
+inline uint64_t now_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// Keeps two redundant connections (legs A and B) to the same streams and writes each kline
+// update to the shared memory once, whichever leg delivers it first. A failed leg reconnects
+// in the background with exponential backoff while the other one keeps the data flowing.
+// Periods the producer may have missed data for are recorded in the log as gap events:
+//     {"e":"gap","E":<now>,"s":"<symbol or *>","from":<ms>,"to":<ms>}
+// `Config` is websocketpp::config::asio_tls_client for wss:// (Binance), or
+// websocketpp::config::asio_client for ws:// (e.g., a local kline_stub_server).
+template <typename Config>
 class BinanceKlineClient {
+    typedef websocketpp::client<Config> WebSocketClient;
+    typedef typename WebSocketClient::message_ptr message_ptr;
+
+    enum { MIN_BACKOFF_MS = 100, MAX_BACKOFF_MS = 10'000 };
+
+    struct FeedLeg {
+        char name;
+        bool connected = false;
+        long backoff_ms = MIN_BACKOFF_MS;
+        uint64_t wins = 0;  // # of updates this leg delivered first
+    };
+
+    // latest update written to the log per symbol, ordered by (open time, last trade id, closed)
+    struct SymbolState {
+        uint64_t open_time = 0;
+        uint64_t close_time = 0;
+        int64_t last_trade_id = -1;
+        bool closed = false;
+    };
+
 public:
-    BinanceKlineClient(SVShmCircularBuffer<KlineData, /* IsProducer: */ true> &shm_bbuffer)
-        : shm_bbuffer_(shm_bbuffer) {
+    BinanceKlineClient(SVShmProducer &shm_bbuffer) : shm_bbuffer_(shm_bbuffer) {
         wsclient_.init_asio();
-        wsclient_.set_tls_init_handler([](websocketpp::connection_hdl hdl) {
+        if constexpr (std::is_same_v<Config, websocketpp::config::asio_tls_client>) {
+            wsclient_.set_tls_init_handler([](websocketpp::connection_hdl hdl) {
+                (void)hdl;
+                return std::make_shared<websocketpp::lib::asio::ssl::context>(
+                    websocketpp::lib::asio::ssl::context::tlsv12_client);
+            });
+        }
+    }
+
+    // connects both legs, connection failures are retried in run()
+    void connect(const std::string &uri) {
+        uri_ = uri;
+        for (FeedLeg &leg : legs_)
+            connect_leg(leg);
+    }
+
+    void run() { wsclient_.run(); }
+
+private:
+    void connect_leg(FeedLeg &leg) {
+        websocketpp::lib::error_code ec;
+        auto con = wsclient_.get_connection(uri_, ec);
+        if (ec) {
+            std::cerr << "Leg " << leg.name << ": error creating connection: " << ec.message()
+                      << "\n";
+            schedule_reconnect(leg);
+            return;
+        }
+        // per-connection handlers so we know which leg an event belongs to
+        con->set_open_handler([this, &leg](websocketpp::connection_hdl hdl) {
             (void)hdl;
-            return std::make_shared<websocketpp::lib::asio::ssl::context>(
-                websocketpp::lib::asio::ssl::context::tlsv12_client);
+            on_open(leg);
         });
-        wsclient_.set_message_handler(
-            [this](websocketpp::connection_hdl hdl, WebSocketClient::message_ptr msg) {
-                on_message(hdl, msg);
-            });
-        wsclient_.set_open_handler([](websocketpp::connection_hdl hdl) {
+        con->set_message_handler([this, &leg](websocketpp::connection_hdl hdl, message_ptr msg) {
             (void)hdl;
-            std::cout << "Connection established.\n";
+            on_message(leg, msg);
         });
-        wsclient_.set_fail_handler([](websocketpp::connection_hdl hdl) {
+        con->set_fail_handler([this, &leg](websocketpp::connection_hdl hdl) {
             (void)hdl;
-            std::cerr << "Connection failed.\n";
+            on_down(leg, "failed");
         });
-        wsclient_.set_close_handler([](websocketpp::connection_hdl hdl) {
+        con->set_close_handler([this, &leg](websocketpp::connection_hdl hdl) {
             (void)hdl;
-            std::cout << "Connection closed.\n";
+            on_down(leg, "closed");
         });
+        wsclient_.connect(con);
     }
 
-    int connect(const std::string &uri) {
-        websocketpp::lib::error_code ec;
-        auto con = wsclient_.get_connection(uri, ec);
-        if (ec) {
-            std::cerr << "Error creating connection: " << ec.message() << "\n";
-            return -1;
+    void schedule_reconnect(FeedLeg &leg) {
+        std::cerr << "Leg " << leg.name << ": reconnecting in " << leg.backoff_ms << "ms\n";
+        wsclient_.set_timer(leg.backoff_ms, [this, &leg](const websocketpp::lib::error_code &ec) {
+            if (!ec)
+                connect_leg(leg);
+        });
+        leg.backoff_ms = std::min<long>(leg.backoff_ms * 2, MAX_BACKOFF_MS);
+    }
+
+    void on_open(FeedLeg &leg) {
+        std::cout << "Leg " << leg.name << ": connection established.\n";
+        leg.connected = true;
+        leg.backoff_ms = MIN_BACKOFF_MS;
+        if (outage_start_ != 0) {
+            // both legs were down, anything may have been missed in between
+            record_gap("*", outage_start_, now_ms());
+            outage_start_ = 0;
         }
-        wsclient_.connect(con);
-        return 0;
     }
 
-    void run() { wsclient_.run(); }
+    void on_down(FeedLeg &leg, const char *what) {
+        std::cerr << "Leg " << leg.name << ": connection " << what << ".\n";
+        if (leg.connected) {
+            leg.connected = false;
+            bool any_connected = std::any_of(std::begin(legs_), std::end(legs_),
+                                             [](const FeedLeg &l) { return l.connected; });
+            if (!any_connected)
+                outage_start_ = now_ms();
+        }
+        schedule_reconnect(leg);
+    }
 
-private:
-    void on_message(websocketpp::connection_hdl hdl, WebSocketClient::message_ptr msg) {
-        (void)hdl;
+    void on_message(FeedLeg &leg, message_ptr msg) {
         std::string_view message = msg->get_payload();
+        yyjson_doc *doc = yyjson_read(message.data(), message.size(), 0);
+        yyjson_val *root = yyjson_doc_get_root(doc);
+        yyjson_val *k_obj = yyjson_obj_get(root, "k");
+        const char *symbol = yyjson_get_str(yyjson_obj_get(root, "s"));
+        if (k_obj && symbol && arbitrate(symbol, k_obj)) {
+            leg.wins++;
+            produce(message);
+            std::cout << "Message received (leg " << leg.name << "): " << message << "\n";
+            print_kline_data(message);
+        }
+        yyjson_doc_free(doc);
+    }
+
+    // returns true if the update is new, i.e., the other leg has not delivered it yet
+    bool arbitrate(const char *symbol, yyjson_val *k_obj) {
+        uint64_t open_time = kline_get_open_time(k_obj);
+        int64_t last_trade_id = kline_get_last_trade_id(k_obj);
+        bool closed = kline_is_closed(k_obj);
+
+        SymbolState &st = symbols_[symbol];
+        if (open_time > st.open_time) {
+            // a new kline, we should have seen the previous one close right before it
+            if (st.open_time != 0 && (!st.closed || open_time > st.close_time + 1))
+                record_gap(symbol, st.open_time, open_time);
+        } else if (open_time < st.open_time || last_trade_id < st.last_trade_id ||
+                   (last_trade_id == st.last_trade_id && (!closed || st.closed))) {
+            return false;
+        }
+
+        st.open_time = open_time;
+        st.close_time = kline_get_close_time(k_obj);
+        st.last_trade_id = last_trade_id;
+        st.closed = closed;
+        return true;
+    }
+
+    void record_gap(const char *symbol, uint64_t from, uint64_t to) {
+        char gap[MAX_KLINE_MSG_SIZE];
+        int n = snprintf(gap, sizeof gap, R"({"e":"gap","E":%lu,"s":"%s","from":%lu,"to":%lu})",
+                         now_ms(), symbol, from, to);
+        produce(std::string_view(gap, std::min<int>(n, sizeof gap - 1)));
+        print_kline_data(gap);
+    }
+
+    void produce(std::string_view message) {
         KlineData kline_data;
-        strncpy(kline_data.msg, message.data(), MAX_KLINE_MSG_SIZE - 1);
-        kline_data.msg[MAX_KLINE_MSG_SIZE - 1] = '\0';
+        size_t n = std::min<size_t>(message.size(), MAX_KLINE_MSG_SIZE - 1);
+        memcpy(kline_data.msg, message.data(), n);
+        kline_data.msg[n] = '\0';
         shm_bbuffer_.produce(kline_data);
-        std::cout << "Message received: " << message << "\n";
-        print_kline_data(message);
     }
 
     SVShmProducer &shm_bbuffer_;
     WebSocketClient wsclient_;
+    std::string uri_;
+    FeedLeg legs_[2] = {{'A'}, {'B'}};
+    uint64_t outage_start_ = 0;
+    std::unordered_map<std::string, SymbolState> symbols_;
 };
 
-void run_producer(int shm_key, idx_t capacity) {
+void run_producer(int shm_key, idx_t capacity, const std::string &uri) {
     SVShmProducer shm_bbuffer(shm_key, capacity, /* shm_id: */ -1, /* use_huge_pages: */ true);
-    BinanceKlineClient client(shm_bbuffer);
-
-    const std::string uri = "wss://stream.binance.com:9443/ws/btcusdt@kline_1m";
-    // or retry n times
-    if (client.connect(uri) == -1)
-        exit(EXIT_FAILURE);
-    client.run();
+    if (uri.rfind("wss://", 0) == 0) {
+        BinanceKlineClient<websocketpp::config::asio_tls_client> client(shm_bbuffer);
+        client.connect(uri);
+        client.run();
+    } else {
+        BinanceKlineClient<websocketpp::config::asio_client> client(shm_bbuffer);
+        client.connect(uri);
+        client.run();
+    }
 }
 
 void run_consumer(int shm_id, idx_t capacity) {
@@ -98,18 +231,96 @@ void run_consumer(int shm_id, idx_t capacity) {
     }
 }
 
+inline double str_to_double(const char *s) { return s ? strtod(s, nullptr) : 0; }
+
+// parses the "k" object of a kline event, prices and volumes are decimal strings
+void parse_kline_bar(yyjson_val *k_obj, uint32_t sym_id, KlineBar &bar) {
+    bar.sym_id = sym_id;
+    bar.closed = kline_is_closed(k_obj);
+    bar.open_time = kline_get_open_time(k_obj);
+    bar.close_time = kline_get_close_time(k_obj);
+    bar.open = str_to_double(kline_get_open(k_obj));
+    bar.high = str_to_double(kline_get_high(k_obj));
+    bar.low = str_to_double(kline_get_low(k_obj));
+    bar.close = str_to_double(kline_get_close(k_obj));
+    bar.volume = str_to_double(kline_get_volume(k_obj));
+    bar.num_trades = yyjson_get_uint(yyjson_obj_get(k_obj, "n"));
+}
+
+// Builds 5m, 15m, 1h and 4h klines from the 1m updates in the log and publishes each interval
+// to its own PShmSegmentedLog, `<out_shm_name>.5m` etc., with segments of `capacity` bars.
+// Every input update publishes a bar per interval, so bounded outputs would fill up long
+// before the circular input wraps; the segmented logs reclaim what every consumer has read.
+// Symbols past the first `max_symbols` are ignored.
+void run_aggregator(int shm_id, idx_t capacity, const std::string &out_shm_name,
+                    size_t max_symbols) {
+    SVShmConsumer shm_bbuffer(0, capacity, shm_id, /* use_huge_pages: */ true);
+    shm_spmc::KlineAggregator<BarProducer> aggregator(max_symbols);
+    std::vector<std::unique_ptr<BarProducer>> outputs;
+    for (int minutes : {5, 15, 60, 240}) {
+        std::string name = out_shm_name + "." + std::to_string(minutes) + "m";
+        outputs.push_back(std::make_unique<BarProducer>(name.c_str(), capacity));
+        aggregator.add_interval(minutes, outputs.back().get());
+    }
+
+    // symbols get dense ids in the order they first appear
+    std::unordered_map<std::string, uint32_t> sym_ids;
+    sym_ids.reserve(max_symbols);
+    std::string symbol;
+    bool warned_max_symbols = false;
+    // parse into a fixed pool instead of the heap, a message needs a few KB at most
+    char pool[16 * 1024];
+    yyjson_alc alc;
+    KlineData item;
+    KlineBar bar;
+    while (true) {
+        shm_bbuffer.consume(&item);
+        yyjson_alc_pool_init(&alc, pool, sizeof pool);
+        yyjson_doc *doc = yyjson_read_opts(item.msg, strlen(item.msg), 0, &alc, nullptr);
+        yyjson_val *root = yyjson_doc_get_root(doc);
+        yyjson_val *k_obj = yyjson_obj_get(root, "k");
+        const char *sym = yyjson_get_str(yyjson_obj_get(root, "s"));
+        // gap events have no "k"
+        if (k_obj && sym) {
+            symbol.assign(sym);
+            auto it = sym_ids.find(symbol);
+            if (it == sym_ids.end() && sym_ids.size() < max_symbols) {
+                it = sym_ids.emplace(symbol, (uint32_t)sym_ids.size()).first;
+            } else if (it == sym_ids.end()) {
+                if (!warned_max_symbols) {
+                    std::cerr << "aggregator: more than " << max_symbols << " symbols, ignoring "
+                              << symbol << " and any other new one\n";
+                    warned_max_symbols = true;
+                }
+                yyjson_doc_free(doc);
+                continue;
+            }
+            parse_kline_bar(k_obj, it->second, bar);
+            if (!aggregator.update(bar)) {
+                std::cerr << "aggregator: can't allocate the next segment of " << out_shm_name
+                          << ".*, is /dev/shm full?\n";
+                exit(EXIT_FAILURE);
+            }
+        }
+        yyjson_doc_free(doc);
+    }
+}
+
 void print_usage_and_exit(const char *app) {
     std::cerr << "Usage:\n"
-              << app << " producer shm_key capacity\n"
-              << app << " consumer shm_id capacity\n";
+              << app << " producer shm_key capacity [uri]\n"
+              << app << " consumer shm_id capacity\n"
+              << app << " aggregate shm_id capacity out_shm_name [max_symbols]\n";
     exit(EXIT_FAILURE);
 }
 
 int main(int argc, const char *argv[]) {
     const char *app = argv[0];
-    if (argc != 4)
+    if (argc < 4)
         print_usage_and_exit(app);
     const std::string app_kind = argv[1];
+    if (app_kind == "aggregate" ? argc > 6 : (argc != 4 && !(argc == 5 && app_kind == "producer")))
+        print_usage_and_exit(app);
     const int shm_key_or_id = std::stoi(argv[2]);
     const idx_t capacity = std::stoul(argv[3]);
     if (capacity <= 0) {
@@ -117,9 +328,14 @@ int main(int argc, const char *argv[]) {
         exit(EXIT_FAILURE);
     }
     if (app_kind == "producer") {
-        run_producer(shm_key_or_id, capacity);
+        // e.g., ws://localhost:9002/ws/btcusdt@kline_1m for a local kline_stub_server
+        const std::string uri =
+            argc == 5 ? argv[4] : "wss://stream.binance.com:9443/ws/btcusdt@kline_1m";
+        run_producer(shm_key_or_id, capacity, uri);
     } else if (app_kind == "consumer") {
         run_consumer(shm_key_or_id, capacity);
+    } else if (app_kind == "aggregate" && argc >= 5) {
+        run_aggregator(shm_key_or_id, capacity, argv[4], argc == 6 ? std::stoul(argv[5]) : 4096);
     } else {
         print_usage_and_exit(app);
     }
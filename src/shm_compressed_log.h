@@ -0,0 +1,358 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+#include "stream_vbyte.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace shm_spmc {
+
+// Encodes blocks of records made of 32-bit words (e.g. one kline timestep) against the previous
+// block: word `w` of record `i` is stored as its delta from word `w` of record `i` in the
+// previous block (0 for records the previous block doesn't have). Feeds that list the same
+// symbols in the same order every timestep leave small deltas, e.g. the same `sym_id` gives 0.
+//
+// A column can also be stored as deltas of those deltas along the block, which the encoder picks
+// per column when it's smaller, e.g. for `time`, whose deltas are the same for every record. The
+// deltas are zigzag mapped and written record by record with Stream VByte, so the decoder turns
+// every 4 of them back into words with one shuffle, subtract, xor and add.
+//
+// A block encoded without a previous one, the first or one after reset(), is a keyframe: it is
+// encoded against zeros and flagged in the header, so decoding can start there.
+//
+// block := [payload size: u32][# of records: u31 | keyframe: 1 bit][2nd order columns: u32
+//           bitmask][svb values]
+template <typename T>
+class DeltaBlockCodec {
+public:
+    static constexpr size_t kWords = sizeof(T) / sizeof(uint32_t);
+    static constexpr size_t kHeaderSize = 3 * sizeof(uint32_t);
+    static constexpr uint32_t kOrderSample = 256;
+    static constexpr uint32_t kKeyframe = 1u << 31;
+    static_assert(sizeof(T) % sizeof(uint32_t) == 0 && kWords <= 32,
+                  "T must be made of at most 32 4-byte words");
+    static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+    static size_t max_block_size(size_t n) {
+        return kHeaderSize + svb_max_encoded_size(n * kWords);
+    }
+
+    // Encodes `items[0, n)` into `out`, which has room for max_block_size(n) bytes, and makes
+    // them the reference of the next block.
+    // returns the block size
+    size_t encode(const T *items, uint32_t n, uint8_t *out) {
+        cur_.resize(n * kWords);
+        memcpy(cur_.data(), items, sizeof *items * n);
+        // records the previous block doesn't have are encoded against zeros
+        if (n > prev_n_)
+            prev_.resize(n * kWords, 0);
+        values_.resize(n * kWords);
+        for (size_t j = 0; j < values_.size(); j++)
+            values_[j] = cur_[j] - prev_[j];
+
+        // pick the order of every column by the encoded size of its first few records
+        size_t first_size[kWords] = {}, second_size[kWords] = {};
+        for (uint32_t i = 0; i < std::min(n, kOrderSample); i++) {
+            for (size_t w = 0; w < kWords; w++) {
+                uint32_t d = values_[i * kWords + w];
+                uint32_t prev_d = i == 0 ? 0 : values_[(i - 1) * kWords + w];
+                first_size[w] += svb_value_size(zigzag_encode(d));
+                second_size[w] += svb_value_size(zigzag_encode(d - prev_d));
+            }
+        }
+        uint32_t second_order = 0;
+        for (size_t w = 0; w < kWords; w++) {
+            if (second_size[w] < first_size[w])
+                second_order |= 1u << w;
+        }
+
+        // backwards, so every delta is still there when the next record needs it
+        for (uint32_t i = n; i-- > 0;) {
+            for (size_t w = 0; w < kWords; w++) {
+                uint32_t &d = values_[i * kWords + w];
+                if ((second_order & (1u << w)) && i != 0)
+                    d -= values_[(i - 1) * kWords + w];
+                d = zigzag_encode(d);
+            }
+        }
+
+        size_t size = kHeaderSize + svb_encode(values_.data(), values_.size(), out + kHeaderSize);
+        uint32_t count = prev_n_ == 0 ? n | kKeyframe : n;
+        uint32_t header[3] = {uint32_t(size - sizeof(uint32_t)), count, second_order};
+        memcpy(out, header, sizeof header);
+        prev_.swap(cur_);
+        prev_n_ = n;
+        return size;
+    }
+
+    // Decodes the block at `in` into `items`, which has room for block_items(in) records, and
+    // makes them the reference of the next block.
+    // returns the block size
+    size_t decode(const uint8_t *in, T *items) {
+        uint32_t header[3];
+        memcpy(header, in, sizeof header);
+        if (header[1] & kKeyframe)
+            reset();
+        const uint32_t n = header[1] & ~kKeyframe;
+        const uint32_t second_order = header[2];
+        const size_t size = sizeof(uint32_t) + header[0];
+
+        // records the previous block doesn't have are encoded against zeros
+        if (n > prev_n_)
+            prev_.resize(n * kWords, 0);
+        cur_.resize(n * kWords);
+        svb_decode_delta(in + kHeaderSize, size - kHeaderSize, cur_.size(), prev_.data(),
+                         cur_.data());
+
+        // the 2nd order columns now hold the previous block + deltas of deltas, usually just a few
+        for (size_t w = 0; w < kWords; w++) {
+            if (!(second_order & (1u << w)))
+                continue;
+            uint32_t d = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t &x = cur_[i * kWords + w];
+                d += x - prev_[i * kWords + w];
+                x = prev_[i * kWords + w] + d;
+            }
+        }
+
+        memcpy(items, cur_.data(), sizeof *items * n);
+        prev_.swap(cur_);
+        prev_n_ = n;
+        return size;
+    }
+
+    static size_t block_size(const uint8_t *in) {
+        uint32_t payload;
+        memcpy(&payload, in, sizeof payload);
+        return sizeof(uint32_t) + payload;
+    }
+
+    static uint32_t block_items(const uint8_t *in) {
+        uint32_t n;
+        memcpy(&n, in + sizeof(uint32_t), sizeof n);
+        return n & ~kKeyframe;
+    }
+
+    // forgets the previous block, so the next one encoded is a keyframe
+    void reset() {
+        prev_.clear();
+        prev_n_ = 0;
+    }
+
+private:
+    std::vector<uint32_t> prev_;  // previous block, row by row
+    uint32_t prev_n_ = 0;
+    std::vector<uint32_t> cur_;
+    std::vector<uint32_t> values_;  // deltas, encoder only
+};
+
+// Append-only log of DeltaBlockCodec blocks in a lock-free byte buffer (PShmBBufferLockFree),
+// which the producer publishes one whole block at a time, so the log fits several times more
+// records and consumers read several times fewer bytes than with raw records.
+//
+// produce_bulk() writes its items as one block; produce() collects items into blocks of up to
+// `block_len` items, which aren't visible to consumers until the block is full or flush()ed.
+// The codec relies on blocks lining up, e.g. one per timestep, so prefer produce_bulk().
+//
+// Every `keyframe_interval` blocks one is a keyframe, whose item index and byte offset the
+// producer appends to a side buffer `shm_name.kf`. seek() starts decoding at the last keyframe
+// before the target, so it decodes at most `keyframe_interval` blocks wherever it lands.
+//
+// `capacity` is in items, i.e. the log gets the space of `capacity` uncompressed items.
+template <typename T, bool IsProducer>
+class PShmCompressedLog {
+public:
+    struct Keyframe {
+        idx_t index;   // # of items before the block
+        idx_t offset;  // of the block in the log
+    };
+
+    explicit PShmCompressedLog(const char *shm_name, idx_t capacity = 0, idx_t block_len = 4096,
+                               idx_t keyframe_interval = 64)
+        : log_(shm_name, capacity * sizeof(T)),
+          // every block takes at least a header
+          keyframes_((std::string(shm_name) + ".kf").c_str(),
+                     capacity * sizeof(T) / DeltaBlockCodec<T>::kHeaderSize / keyframe_interval +
+                         1),
+          block_len_(block_len),
+          keyframe_interval_(keyframe_interval) {
+        if constexpr (IsProducer)
+            pending_.reserve(block_len);
+    }
+
+    ~PShmCompressedLog() {
+        if constexpr (IsProducer)
+            flush();
+    }
+
+    // producer appends an item to the pending block, which gets published once it is full
+    // returns false if the log is full
+    bool produce(const T &item) {
+        static_assert(IsProducer, "can only be called from producers");
+        pending_.push_back(item);
+        if (pending_.size() < block_len_)
+            return true;
+        return flush();
+    }
+
+    // producer publishes the pending block and then `items[0, n)` as one block
+    // returns `n`, or 0 if the log is full
+    idx_t produce_bulk(const T *items, idx_t n) {
+        static_assert(IsProducer, "can only be called from producers");
+        if (!flush() || !produce_block(items, n))
+            return 0;
+        return n;
+    }
+
+    // producer publishes the pending items
+    // returns false if the log is full
+    bool flush() {
+        static_assert(IsProducer, "can only be called from producers");
+        if (pending_.empty())
+            return true;
+        bool ok = produce_block(pending_.data(), pending_.size());
+        pending_.clear();
+        return ok;
+    }
+
+    // consumer retrieves an item from the log head, decoding the next block when needed
+    int consume(T &item) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        if (batch_pos_ == batch_.size()) {
+            int rc = next_block();
+            if (rc != CONSUME_SUCCESS)
+                return rc;
+        }
+        item = batch_[batch_pos_++];
+        return CONSUME_SUCCESS;
+    }
+
+    // Moves the consumer's head to item `index`, clamped to the published items. Blocks are
+    // encoded against each other, so this jumps to the last keyframe at or before `index`,
+    // unless the head is already past it, and decodes the blocks from there. Like
+    // PShmBBufferLockFree::seek(), don't seek back behind what set_release_chunk() unmapped.
+    void seek(idx_t index) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        const Keyframe *kf = last_keyframe(index);
+        if (kf != nullptr && (kf->index > position() || index < position())) {
+            log_.seek(kf->offset);
+            codec_.reset();
+            batch_.clear();
+            batch_pos_ = 0;
+            head_ = kf->index;
+        }
+        while (position() < index) {
+            idx_t left = index - position();
+            if (left <= batch_.size() - batch_pos_) {
+                batch_pos_ += left;
+                break;
+            }
+            batch_pos_ = batch_.size();
+            if (next_block() != CONSUME_SUCCESS)
+                break;
+        }
+    }
+
+    // # of items before the consumer's head
+    idx_t position() const { return head_ - (batch_.size() - batch_pos_); }
+
+    // # of bytes published so far
+    idx_t compressed_size() const { return log_.size(); }
+
+    // see PShmBBufferLockFree, the chunk is in compressed bytes
+    void set_release_chunk(size_t chunk_bytes) { log_.set_release_chunk(chunk_bytes); }
+
+    void set_streaming_stores(bool enable) { log_.set_streaming_stores(enable); }
+
+    // The consumer prefetches the compressed bytes `dist` cache lines past each block it
+    // decodes, 0 disables it.
+    void set_prefetch_distance(idx_t dist) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        prefetch_dist_ = dist;
+    }
+
+private:
+    bool produce_block(const T *items, idx_t n) {
+        if (n == 0)
+            return true;
+        if (full_)
+            return false;
+        bool keyframe = num_blocks_ % keyframe_interval_ == 0;
+        if (keyframe)
+            codec_.reset();
+        scratch_.resize(DeltaBlockCodec<T>::max_block_size(n));
+        size_t size = codec_.encode(items, n, scratch_.data());
+        // All or nothing, consumers must never see a partial block. The encoder already took
+        // the block as the reference of the next one, so nothing can be appended after it.
+        if (size > log_.capacity() - log_.size()) {
+            full_ = true;
+            return false;
+        }
+        idx_t offset = log_.size();
+        log_.produce_bulk(scratch_.data(), size);
+        // after the block, so consumers only find published keyframes; if the table is full,
+        // seek() just decodes from an earlier one
+        if (keyframe)
+            keyframes_.produce({items_, offset});
+        num_blocks_++;
+        items_ += n;
+        return true;
+    }
+
+    // the last published keyframe at or before item `index`, nullptr if there is none
+    const Keyframe *last_keyframe(idx_t index) {
+        const Keyframe *entries;
+        idx_t n;
+        // never advanced, so peek() returns the whole table; seek() reloads the tail
+        keyframes_.seek(0);
+        if (keyframes_.peek(entries, n, ~idx_t(0)) != CONSUME_SUCCESS)
+            return nullptr;
+        const Keyframe *it = std::upper_bound(
+            entries, entries + n, index, [](idx_t i, const Keyframe &kf) { return i < kf.index; });
+        return it == entries ? nullptr : &it[-1];
+    }
+
+    int next_block() {
+        const uint8_t *block;
+        idx_t avail;
+        // the producer publishes whole blocks, so any published byte starts a complete one
+        int rc = log_.peek(block, avail, ~idx_t(0));
+        if (rc != CONSUME_SUCCESS)
+            return rc;
+
+        size_t size = DeltaBlockCodec<T>::block_size(block);
+        assert(size <= avail);
+        for (idx_t i = 1; i <= prefetch_dist_ && size + i * 64 < avail; i++)
+            prefetch_read(block + size + i * 64);
+        batch_.resize(DeltaBlockCodec<T>::block_items(block));
+        codec_.decode(block, batch_.data());
+        batch_pos_ = 0;
+        head_ += batch_.size();
+        log_.advance(size);
+        return CONSUME_SUCCESS;
+    }
+
+    PShmBBufferLockFree<uint8_t, IsProducer> log_;
+    PShmBBufferLockFree<Keyframe, IsProducer> keyframes_;
+    DeltaBlockCodec<T> codec_;
+    const idx_t block_len_;
+    const idx_t keyframe_interval_;
+
+    // producer only
+    std::vector<T> pending_;
+    std::vector<uint8_t> scratch_;
+    bool full_ = false;
+    idx_t num_blocks_ = 0;
+    idx_t items_ = 0;  // # of items published
+
+    // consumer only
+    std::vector<T> batch_;  // the last decoded block
+    size_t batch_pos_ = 0;
+    idx_t head_ = 0;  // # of items decoded
+    idx_t prefetch_dist_ = 0;
+};
+
+}  // namespace shm_spmc
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+
+namespace shm_spmc {
+
+struct ShmControlBlockLastValue {
+    idx_t cap_;
+};
+
+// One entry per cache line so updates to different symbols never contend.
+template <typename T>
+struct LastValueEntry {
+    // odd while the producer is writing `value_`, 0 if it has never been written
+    CACHELINE_ALIGNED std::atomic<uint32_t> seq_;
+    T value_;
+};
+
+// Latest value per key (e.g., the current kline per symbol id) in POSIX shared memory.
+//
+// Each entry is protected by a seqlock: the single producer bumps the sequence number to odd,
+// writes the value and bumps it back to even; readers retry if the sequence number was odd or
+// changed while they copied the value. Readers never write to shared memory, so any number of
+// them get a consistent snapshot of any key in O(1) without slowing down the producer, and a
+// late joiner starts from the current state instead of replaying the log.
+template <typename T, bool IsProducer>
+class PShmLastValueCache {
+public:
+    // `capacity` is the # of keys, i.e., valid keys are in [0, capacity)
+    explicit PShmLastValueCache(const char *shm_name, idx_t capacity = 0) : shm_name_(shm_name) {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+        int shm_fd = -1;
+        if constexpr (IsProducer) {
+            shm_fd = create_shm_object(shm_name);
+        } else {
+            shm_fd = shm_open(shm_name, O_RDONLY, 0600);
+        }
+        if (shm_fd == -1)
+            handle_error("shm_open");
+
+        if constexpr (IsProducer) {
+            // all sequence numbers are initialized to zero by ftruncate
+            if (ftruncate(shm_fd, get_shm_size(capacity)) == -1)
+                handle_error("ftruncate");
+        } else {
+            // consumer can read the capacity from the shared memory
+            ssize_t nbytes = ::read(shm_fd, &capacity, sizeof capacity);
+            assert(nbytes == sizeof capacity);
+        }
+
+        constexpr int flags = IsProducer ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void *shmp = mmap(nullptr, get_shm_size(capacity), flags, MAP_SHARED, shm_fd, 0);
+        if (shmp == MAP_FAILED)
+            handle_error("mmap");
+        close(shm_fd);
+
+        cb_ = static_cast<ShmControlBlockLastValue *>(shmp);
+        if constexpr (IsProducer) {
+            cb_->cap_ = capacity;
+            publish_shm_object(shm_name);
+        }
+        // the control block is padded to a whole entry to keep entries cache line aligned
+        entries_ = static_cast<LastValueEntry<T> *>(shmp) + 1;
+    }
+
+    ~PShmLastValueCache() {
+        munmap(cb_, get_shm_size(cb_->cap_));
+        // destroys the shared object only when all processes have unmapped it
+        // shm_unlink(shm_name_.c_str());
+    }
+
+    // producer overwrites the latest value of `key`
+    void update(idx_t key, const T &item) {
+        static_assert(IsProducer, "can only be called from producers");
+        assert(key < cb_->cap_);
+
+        LastValueEntry<T> &entry = entries_[key];
+        uint32_t seq = entry.seq_.load(std::memory_order_relaxed);
+        entry.seq_.store(seq + 1, std::memory_order_relaxed);
+        // keeps the stores to `value_` from becoming visible before the odd sequence number
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&entry.value_, &item, sizeof item);
+        entry.seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    // consumer takes a consistent snapshot of the latest value of `key`
+    // returns false if `key` has never been written
+    bool read(idx_t key, T &item) const {
+        static_assert(!IsProducer, "can only be called from consumers");
+        assert(key < cb_->cap_);
+
+        const LastValueEntry<T> &entry = entries_[key];
+        while (true) {
+            uint32_t seq = entry.seq_.load(std::memory_order_acquire);
+            if (seq == 0)
+                return false;
+            if (seq & 1)
+                continue;  // the producer is writing it
+            memcpy(&item, &entry.value_, sizeof item);
+            // keeps the loads of `value_` from being reordered after the second load of `seq_`
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.seq_.load(std::memory_order_relaxed) == seq)
+                return true;
+        }
+    }
+
+    // # of times `key` has been written, also lets a polling reader detect changes cheaply
+    uint32_t version(idx_t key) const {
+        return entries_[key].seq_.load(std::memory_order_acquire) / 2;
+    }
+
+    idx_t capacity() const { return cb_->cap_; }
+
+    const std::string &shm_name() const { return shm_name_; }
+
+private:
+    static size_t get_shm_size(idx_t cap) { return sizeof(LastValueEntry<T>) * (cap + 1); }
+
+    const std::string shm_name_;
+
+    ShmControlBlockLastValue *cb_;
+    LastValueEntry<T> *entries_;
+};
+
+}  // namespace shm_spmc
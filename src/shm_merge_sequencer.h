@@ -0,0 +1,116 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace shm_spmc {
+
+// Merges several time-ordered single-producer buffers into one time-ordered output buffer.
+//
+// Each producer keeps writing its own lock-free SPSC/SPMC buffer, so none of the single-producer
+// fast paths needs extra atomics. The sequencer thread is a consumer of every input and the only
+// producer of the output. It emits the pending item with the smallest time once every live input
+// has an item pending (nothing older can arrive then), or once that item is `window` older than
+// the newest time seen, so a stalled input delays the output by at most `window`.
+//
+// An item that shows up older than the last emitted one (its input stalled for longer than the
+// window) is still emitted right away, and counted in late_items().
+//
+// `Consumer` and `Producer` are e.g. PShmBBufferLockFree<T, false> and
+// PShmBBufferGiacomoni<T, true>, `TimeOf` maps an item to its event time.
+template <typename T, typename Consumer, typename Producer, typename TimeOf>
+class MergeSequencer {
+public:
+    MergeSequencer(std::vector<Consumer *> inputs, Producer &output, int64_t window,
+                   TimeOf time_of = TimeOf())
+        : inputs_(std::move(inputs)),
+          states_(inputs_.size()),
+          output_(output),
+          window_(window),
+          time_of_(time_of) {}
+
+    // Moves at most one item to the output.
+    // returns CONSUME_SUCCESS if an item was emitted, CONSUME_AGAIN if it has to wait for the
+    // inputs, CONSUME_FINISHED once all inputs are finished and drained
+    int step() {
+        bool all_pending = true;
+        int min_i = -1;
+        for (size_t i = 0; i < inputs_.size(); i++) {
+            InputState &st = states_[i];
+            if (!st.pending && !st.finished) {
+                int rc = inputs_[i]->consume(st.item);
+                if (rc == CONSUME_SUCCESS) {
+                    st.pending = true;
+                    st.time = time_of_(st.item);
+                    max_time_ = std::max(max_time_, st.time);
+                } else if (rc == CONSUME_FINISHED) {
+                    st.finished = true;
+                }
+            }
+            if (!st.pending) {
+                all_pending &= st.finished;
+                continue;
+            }
+            // ties go to the lower input index, which keeps the merge deterministic
+            if (min_i == -1 || st.time < states_[min_i].time)
+                min_i = i;
+        }
+
+        if (min_i == -1)
+            return all_pending ? CONSUME_FINISHED : CONSUME_AGAIN;
+
+        InputState &st = states_[min_i];
+        if (!all_pending && max_time_ - st.time < window_)
+            return CONSUME_AGAIN;
+
+        if (!output_.produce(st.item)) {
+            fprintf(stderr, "merge sequencer: output buffer is full\n");
+            exit(EXIT_FAILURE);
+        }
+        if (emitted_ != 0 && st.time < last_time_)
+            late_++;
+        else
+            last_time_ = st.time;
+        st.pending = false;
+        emitted_++;
+        return CONSUME_SUCCESS;
+    }
+
+    // Merges until all inputs are finished, sleeping `idle_sleep` whenever nothing can be emitted.
+    void run(std::chrono::microseconds idle_sleep = std::chrono::microseconds(100)) {
+        int rc;
+        while ((rc = step()) != CONSUME_FINISHED) {
+            if (rc == CONSUME_AGAIN)
+                std::this_thread::sleep_for(idle_sleep);
+        }
+    }
+
+    idx_t emitted_items() const { return emitted_; }
+    idx_t late_items() const { return late_; }
+
+private:
+    struct InputState {
+        T item;
+        int64_t time = 0;
+        bool pending = false;
+        bool finished = false;
+    };
+
+    std::vector<Consumer *> inputs_;
+    std::vector<InputState> states_;
+    Producer &output_;
+    const int64_t window_;
+    TimeOf time_of_;
+
+    int64_t max_time_ = INT64_MIN;
+    int64_t last_time_ = INT64_MIN;
+    idx_t emitted_ = 0;
+    idx_t late_ = 0;
+};
+
+}  // namespace shm_spmc
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace shm_spmc {
+
+// One stage of a pipeline of processes: consumes one or more SPMC buffers in batches, runs `fn`
+// on every batch and publishes what it emits to its own output buffer. Any number of downstream
+// consumers then share the derived stream instead of each recomputing it from the raw one.
+//
+// `fn(size_t input, const In *items, size_t n, std::vector<Out> &out)` gets up to `batch_size`
+// items of input `input` at a time and appends its results to `out`, which the stage then
+// publishes with a single produce_bulk(). The output is finished (writer_finished_) when the
+// `Producer` is destroyed, so run() the stage to the end of its inputs first.
+//
+// `Consumer` and `Producer` are e.g. PShmBBufferGiacomoni<In, false> and
+// PShmBBufferLockFree<Out, true>.
+template <typename In, typename Out, typename Consumer, typename Producer, typename Fn>
+class PipelineStage {
+public:
+    PipelineStage(std::vector<Consumer *> inputs, Producer &output, Fn fn,
+                  size_t batch_size = 1024)
+        : inputs_(std::move(inputs)),
+          finished_(inputs_.size(), false),
+          output_(output),
+          fn_(std::move(fn)),
+          batch_size_(batch_size) {
+        in_.reserve(batch_size);
+    }
+
+    // Runs `fn` on at most one batch of every input.
+    // returns CONSUME_SUCCESS if any item was consumed, CONSUME_AGAIN if all live inputs are
+    // empty, CONSUME_FINISHED once all inputs are finished and drained
+    int step() {
+        bool consumed = false, all_finished = true;
+        for (size_t i = 0; i < inputs_.size(); i++) {
+            if (finished_[i])
+                continue;
+            // a partial batch is passed on right away rather than waiting for more items
+            in_.resize(batch_size_);
+            size_t n = 0;
+            int rc = CONSUME_SUCCESS;
+            while (n < batch_size_ && (rc = inputs_[i]->consume(in_[n])) == CONSUME_SUCCESS)
+                n++;
+            if (rc == CONSUME_FINISHED)
+                finished_[i] = true;
+            else
+                all_finished = false;
+            if (n == 0)
+                continue;
+
+            consumed = true;
+            consumed_ += n;
+            out_.clear();
+            fn_(i, in_.data(), n, out_);
+            publish();
+        }
+        if (consumed)
+            return CONSUME_SUCCESS;
+        return all_finished ? CONSUME_FINISHED : CONSUME_AGAIN;
+    }
+
+    // Runs until all inputs are finished, sleeping `idle_sleep` whenever they are all empty.
+    void run(std::chrono::microseconds idle_sleep = std::chrono::microseconds(100)) {
+        int rc;
+        while ((rc = step()) != CONSUME_FINISHED) {
+            if (rc == CONSUME_AGAIN)
+                std::this_thread::sleep_for(idle_sleep);
+        }
+    }
+
+    idx_t consumed_items() const { return consumed_; }
+    idx_t produced_items() const { return produced_; }
+
+private:
+    void publish() {
+        if (out_.empty())
+            return;
+        if (output_.produce_bulk(out_.data(), out_.size()) != out_.size()) {
+            fprintf(stderr, "pipeline stage: output buffer is full\n");
+            exit(EXIT_FAILURE);
+        }
+        produced_ += out_.size();
+    }
+
+    std::vector<Consumer *> inputs_;
+    std::vector<bool> finished_;
+    Producer &output_;
+    Fn fn_;
+    const size_t batch_size_;
+
+    std::vector<In> in_;
+    std::vector<Out> out_;
+    idx_t consumed_ = 0;
+    idx_t produced_ = 0;
+};
+
+}  // namespace shm_spmc
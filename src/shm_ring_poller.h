@@ -0,0 +1,206 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+namespace shm_spmc {
+
+struct ShmControlBlockDoorbell {
+    std::atomic<uint32_t> seq_;
+    CACHELINE_ALIGNED std::atomic<uint32_t> waiters_;
+};
+
+// A futex word in shared memory that producers of any number of buffers ring after publishing,
+// so a RingPoller can sleep until one of them has data instead of spinning. (An eventfd would
+// have to be passed to every producer process over a unix socket first.)
+//
+// ring() costs the producer a full fence and a load while nobody waits. It bumps the futex word
+// and wakes the waiters only when the poller has announced itself, which it does before its
+// last check of the buffers, so either the poller sees the new item or the producer sees it.
+class PShmDoorbell {
+public:
+    // one process creates the doorbell, the others open it
+    PShmDoorbell(const char *shm_name, bool create) : shm_name_(shm_name) {
+        int shm_fd = create ? create_shm_object(shm_name) : shm_open(shm_name, O_RDWR, 0600);
+        if (shm_fd == -1)
+            handle_error("shm_open");
+        // ftruncate() zeroes the control block
+        if (create && ftruncate(shm_fd, sizeof *cb_) == -1)
+            handle_error("ftruncate");
+        void *shmp = mmap(nullptr, sizeof *cb_, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        if (shmp == MAP_FAILED)
+            handle_error("mmap");
+        close(shm_fd);
+        cb_ = static_cast<ShmControlBlockDoorbell *>(shmp);
+        if (create)
+            publish_shm_object(shm_name);
+    }
+
+    ~PShmDoorbell() {
+        munmap(cb_, sizeof *cb_);
+        // shm_unlink(shm_name_.c_str());
+    }
+
+    // producer rings the doorbell after publishing items, e.g. once per produce_bulk()
+    void ring() {
+        // orders the publish before the load of `waiters_`, see wait()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (likely(cb_->waiters_.load(std::memory_order_relaxed) == 0))
+            return;
+        cb_->seq_.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, &cb_->seq_, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    // Sleeps until ring() is called or `timeout` passes, unless `has_data()` returns true after
+    // this waiter is announced. returns true if woken or there is data
+    template <typename HasData>
+    bool wait(HasData has_data, std::chrono::microseconds timeout) {
+        cb_->waiters_.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t seen = cb_->seq_.load(std::memory_order_acquire);
+        bool ready = has_data();
+        if (!ready) {
+            timespec ts{timeout.count() / 1'000'000, timeout.count() % 1'000'000 * 1'000};
+            long rc = syscall(SYS_futex, &cb_->seq_, FUTEX_WAIT, seen, &ts, nullptr, 0);
+            ready = rc == 0 || errno != ETIMEDOUT;
+        }
+        cb_->waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return ready;
+    }
+
+    const std::string &shm_name() const { return shm_name_; }
+
+private:
+    const std::string shm_name_;
+    ShmControlBlockDoorbell *cb_;
+};
+
+enum class PollPolicy {
+    ROUND_ROBIN,  // every ring gets its turn, priorities are ignored
+    PRIORITY,     // rings with a higher priority first, round-robin among equal ones
+};
+
+// Lets one consumer thread service many buffers, e.g. rings sharded by symbol or feed, instead
+// of a thread per ring.
+//
+// poll() retrieves one item from the next ring with data. Rings with data are served from the
+// consumer's cached tail (PShmBBufferLockFree) without touching shared lines, and an idle ring
+// costs one failed consume(): a load of its tail or head slot flag (PShmBBufferGiacomoni), a
+// line the idle producer doesn't write, so it stays in this core's cache. wait() sleeps on a
+// PShmDoorbell until any producer rings it. Producers don't ring when they finish, so make them
+// ring() once more after their buffer is destroyed, or the poller notices on its next timeout.
+//
+// `Consumer` is e.g. PShmBBufferLockFree<T, false>, the poller doesn't own the rings.
+template <typename T, typename Consumer>
+class RingPoller {
+public:
+    explicit RingPoller(PollPolicy policy = PollPolicy::ROUND_ROBIN) : policy_(policy) {}
+
+    // registers a ring, returns its id (0, 1, ... in the order added)
+    size_t add(Consumer *ring, int priority = 0) {
+        size_t id = num_rings_++;
+        Ring r{ring, id, policy_ == PollPolicy::PRIORITY ? priority : 0, false};
+        // keep the rings sorted by priority, in the order added among equal ones
+        auto it = std::upper_bound(rings_.begin(), rings_.end(), r,
+                                   [](const Ring &a, const Ring &b) {
+                                       return a.priority > b.priority;
+                                   });
+        rings_.insert(it, r);
+        build_groups();
+        return id;
+    }
+
+    // Retrieves an item from the next ring with data and sets `ring_id` to its id.
+    // returns CONSUME_SUCCESS, CONSUME_AGAIN if all live rings are empty, CONSUME_FINISHED once
+    // every ring is finished and drained
+    int poll(T &item, size_t &ring_id) {
+        bool all_finished = true;
+        for (Group &g : groups_) {
+            size_t n = g.end - g.begin;
+            for (size_t k = 0; k < n; k++) {
+                size_t i = g.begin + (g.next + k) % n;
+                Ring &r = rings_[i];
+                if (r.finished)
+                    continue;
+                int rc = r.consumer->consume(item);
+                if (rc == CONSUME_SUCCESS) {
+                    // the next poll starts after this ring
+                    g.next = (g.next + k + 1) % n;
+                    ring_id = r.id;
+                    return CONSUME_SUCCESS;
+                }
+                if (rc == CONSUME_FINISHED)
+                    r.finished = true;
+                else
+                    all_finished = false;
+            }
+        }
+        return all_finished ? CONSUME_FINISHED : CONSUME_AGAIN;
+    }
+
+    // Like poll(), but while all rings are empty it spins `spin` polls, then sleeps on
+    // `doorbell` until a producer rings it or `timeout` passes. Without a doorbell it just sleeps
+    // `timeout` and polls once more.
+    // returns CONSUME_AGAIN if there is still no data after waking up
+    int wait(T &item, size_t &ring_id, PShmDoorbell *doorbell,
+             std::chrono::microseconds timeout = std::chrono::microseconds(100'000),
+             int spin = 100) {
+        for (int i = 0; i < spin; i++) {
+            int rc = poll(item, ring_id);
+            if (rc != CONSUME_AGAIN)
+                return rc;
+        }
+        int rc = CONSUME_AGAIN;
+        auto has_data = [&]() { return (rc = poll(item, ring_id)) != CONSUME_AGAIN; };
+        if (doorbell == nullptr) {
+            std::this_thread::sleep_for(timeout);
+            has_data();
+            return rc;
+        }
+        if (doorbell->wait(has_data, timeout) && rc == CONSUME_AGAIN)
+            has_data();
+        return rc;
+    }
+
+    size_t size() const { return num_rings_; }
+
+private:
+    struct Ring {
+        Consumer *consumer;
+        size_t id;
+        int priority;
+        bool finished;
+    };
+
+    // rings [begin, end) of the same priority, polled round-robin from `next`
+    struct Group {
+        size_t begin;
+        size_t end;
+        size_t next;
+    };
+
+    void build_groups() {
+        groups_.clear();
+        for (size_t i = 0; i < rings_.size(); i++) {
+            if (i == 0 || rings_[i].priority != rings_[i - 1].priority)
+                groups_.push_back({i, i, 0});
+            groups_.back().end = i + 1;
+        }
+    }
+
+    const PollPolicy policy_;
+    std::vector<Ring> rings_;
+    std::vector<Group> groups_;
+    size_t num_rings_ = 0;
+};
+
+}  // namespace shm_spmc
@@ -0,0 +1,457 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+
+#include <algorithm>
+
+namespace shm_spmc {
+
+enum { MAX_SEGMENTED_LOG_CONSUMERS = 64 };
+
+// Each registered consumer publishes the segment it is currently reading, so the producer
+// knows which segments are still needed. One slot per cache line, as consumers write them.
+// `seg_no_` of a free slot is kNoSegment, so a consumer that just claimed it pins nothing until
+// it stores its own segment.
+struct SegmentedLogConsumerSlot {
+    static constexpr idx_t kNoSegment = ~idx_t(0);
+
+    CACHELINE_ALIGNED std::atomic<bool> in_use_;
+    std::atomic<idx_t> seg_no_;
+};
+
+// Lives in the root shared memory object `shm_name`.
+struct ShmControlBlockSegmented {
+    idx_t seg_cap_;                   // # of items per segment
+    std::atomic<idx_t> head_seg_;     // oldest segment joining consumers start at, never decreases
+    std::atomic<idx_t> tail_seg_;     // segment the producer is currently writing
+    std::atomic<idx_t> reclaimed_seg_;  // segments before this one have been unlinked
+    std::atomic<bool> writer_finished_;
+    std::atomic<idx_t> num_registered_;  // # of consumers that have ever registered
+    idx_t min_consumers_;                // no reclamation until this many have registered
+    SegmentedLogConsumerSlot consumers_[MAX_SEGMENTED_LOG_CONSUMERS];
+};
+
+// Lives at the start of every segment `shm_name.<seg_no>`.
+struct ShmSegmentHeader {
+    idx_t seg_no_;
+    std::atomic<idx_t> tail_;
+    // set (with release semantics) once segment `seg_no_ + 1` is fully initialized
+    CACHELINE_ALIGNED std::atomic<bool> has_next_;
+};
+
+// Unbounded single-producer multi-consumer log made of fixed-size segments.
+//
+// The producer allocates segment N+1 when segment N fills up and links it through the header
+// of segment N; consumers follow the link transparently. Segments that every registered
+// consumer has moved past get unlinked, and both sides only keep the segment they are working
+// on mapped, so memory tracks the live window instead of the worst-case day.
+//
+// With no consumer registered every full segment gets reclaimed, so consumers attaching late
+// start from the oldest live segment. Pass `min_consumers` to the producer to retain the whole
+// log until that many consumers have attached.
+//
+// Whichever of the producer and the registered consumers leaves last, after the producer has
+// finished, unlinks the remaining segments and the control object, so a consumer still catching
+// up can follow the links to the end. Consumers attaching after that find no log.
+//
+// Note a consumer that dies without running its destructor keeps its slot, and thus pins the
+// segment it was reading, and the log is not unlinked.
+template <typename T, bool IsProducer>
+class PShmSegmentedLog {
+public:
+    // `seg_cap` is the # of items per segment, consumers read it from the shared memory.
+    explicit PShmSegmentedLog(const char *shm_name, idx_t seg_cap = 0, idx_t min_consumers = 0)
+        : shm_name_(shm_name) {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+        int shm_fd = -1;
+        if constexpr (IsProducer) {
+            shm_fd = create_shm_object(shm_name);
+        } else {
+            // consumers write their own slot in the control block
+            shm_fd = shm_open(shm_name, O_RDWR, 0600);
+        }
+        if (shm_fd == -1)
+            handle_error("shm_open");
+
+        if constexpr (IsProducer) {
+            if (ftruncate(shm_fd, sizeof *cb_) == -1)
+                handle_error("ftruncate");
+        }
+
+        void *shmp = mmap(nullptr, sizeof *cb_, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        if (shmp == MAP_FAILED)
+            handle_error("mmap");
+        close(shm_fd);
+
+        cb_ = static_cast<ShmControlBlockSegmented *>(shmp);
+        if constexpr (IsProducer) {
+            assert(seg_cap > 0);
+            cb_->seg_cap_ = seg_cap;
+            // ftruncate() already zeroed the memory, here for clarity
+            cb_->head_seg_.store(0, std::memory_order_relaxed);
+            cb_->tail_seg_.store(0, std::memory_order_relaxed);
+            cb_->reclaimed_seg_.store(0, std::memory_order_relaxed);
+            cb_->writer_finished_.store(false, std::memory_order_relaxed);
+            cb_->num_registered_.store(0, std::memory_order_relaxed);
+            cb_->min_consumers_ = min_consumers;
+            for (auto &slot : cb_->consumers_)
+                slot.seg_no_.store(SegmentedLogConsumerSlot::kNoSegment, std::memory_order_relaxed);
+            if (!create_segment(0))
+                exit(EXIT_FAILURE);
+            seg_ = map_segment(0);
+            if (seg_ == nullptr)
+                exit(EXIT_FAILURE);
+            publish_shm_object(shm_name);
+        } else {
+            register_consumer();
+        }
+    }
+
+    ~PShmSegmentedLog() {
+        // Producer: store `writer_finished_`, then scan the slots. Consumer: free the slot, then
+        // load `writer_finished_`. Both seq_cst, so at least the last one to leave sees no
+        // consumer attached after the producer finished, and unlinks the log. Unlinking twice is
+        // harmless, and the objects are destroyed only when all processes have unmapped them.
+        bool last;
+        if constexpr (IsProducer) {
+            cb_->writer_finished_.store(true, std::memory_order_seq_cst);
+            last = !any_consumer_attached();
+        } else {
+            SegmentedLogConsumerSlot &slot = cb_->consumers_[slot_];
+            slot.seg_no_.store(SegmentedLogConsumerSlot::kNoSegment, std::memory_order_relaxed);
+            slot.in_use_.store(false, std::memory_order_seq_cst);
+            last = cb_->writer_finished_.load(std::memory_order_seq_cst) &&
+                   !any_consumer_attached();
+        }
+        if (last)
+            unlink_log();
+        if (seg_ != nullptr)
+            munmap(seg_, segment_size());
+        munmap(cb_, sizeof *cb_);
+    }
+
+    // producer appends an item to the log tail, allocating a new segment if necessary
+    // returns false if the next segment cannot be allocated
+    bool produce(const T &item) {
+        static_assert(IsProducer, "can only be called from producers");
+
+        idx_t tail = seg_->tail_.load(std::memory_order_relaxed);
+        if (unlikely(tail == cb_->seg_cap_)) {
+            if (!advance_producer())
+                return false;
+            tail = 0;
+        }
+
+        if (streaming_stores_) {
+            stream_copy(&buffer_[tail], &item, sizeof item);
+            store_fence();
+        } else {
+            memcpy(&buffer_[tail], &item, sizeof item);
+        }
+        seg_->tail_.store(tail + 1, std::memory_order_release);
+        if (unlikely(tail + 1 >= next_release_))
+            release_behind(tail + 1);
+        return true;
+    }
+
+    // producer appends `n` items to the log tail, publishing them once per segment
+    // returns the # of items appended, which is less than `n` if a segment cannot be allocated
+    idx_t produce_bulk(const T *items, idx_t n) {
+        static_assert(IsProducer, "can only be called from producers");
+
+        idx_t done = 0;
+        while (done < n) {
+            idx_t tail = seg_->tail_.load(std::memory_order_relaxed);
+            if (unlikely(tail == cb_->seg_cap_)) {
+                if (!advance_producer())
+                    break;
+                tail = 0;
+            }
+
+            idx_t cnt = std::min(n - done, cb_->seg_cap_ - tail);
+            if (streaming_stores_) {
+                stream_copy(&buffer_[tail], &items[done], sizeof *items * cnt);
+                store_fence();
+            } else {
+                memcpy(&buffer_[tail], &items[done], sizeof *items * cnt);
+            }
+            seg_->tail_.store(tail + cnt, std::memory_order_release);
+            if (unlikely(tail + cnt >= next_release_))
+                release_behind(tail + cnt);
+            done += cnt;
+        }
+        return done;
+    }
+
+    // consumer retrieves an item from the log head
+    int consume(T &item) {
+        static_assert(!IsProducer, "can only be called from consumers");
+
+        if (head_ == cached_tail_) {
+            if (unlikely(head_ == cb_->seg_cap_)) {
+                // the producer only links the next segment after filling this one
+                bool finished = cb_->writer_finished_.load(std::memory_order_acquire);
+                if (!seg_->has_next_.load(std::memory_order_acquire))
+                    return finished ? CONSUME_FINISHED : CONSUME_AGAIN;
+                advance_consumer();
+            }
+            // load `writer_finished_` before `tail_` so no item published before it is missed
+            bool finished = cb_->writer_finished_.load(std::memory_order_acquire);
+            cached_tail_ = seg_->tail_.load(std::memory_order_acquire);
+            if (head_ == cached_tail_)
+                return finished ? CONSUME_FINISHED : CONSUME_AGAIN;
+        }
+
+        if (prefetch_dist_ != 0 && head_ + prefetch_dist_ < cached_tail_)
+            prefetch_read(&buffer_[head_ + prefetch_dist_]);
+        memcpy(&item, &buffer_[head_], sizeof item);
+        head_++;
+        if (unlikely(head_ >= next_release_))
+            release_behind(head_);
+        return CONSUME_SUCCESS;
+    }
+
+    idx_t capacity() const { return cb_->seg_cap_; }
+
+    // global log index of the consumer's next item, segment # * capacity + offset
+    idx_t position() const { return seg_->seg_no_ * cb_->seg_cap_ + head_; }
+
+    // Moves the consumer to the global log index `index`, following the links as far as the
+    // producer has written. Returns false if it didn't get there, see position() for where it
+    // is: an earlier segment may have been reclaimed already, so the head stays put, and an
+    // index the producer hasn't written yet stops the head at the last published item.
+    bool seek(idx_t index) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        idx_t seg_no = index / cb_->seg_cap_;
+        idx_t offset = index % cb_->seg_cap_;
+        if (seg_no < seg_->seg_no_)
+            return false;
+        while (seg_->seg_no_ < seg_no) {
+            if (!seg_->has_next_.load(std::memory_order_acquire)) {
+                offset = cb_->seg_cap_;
+                break;
+            }
+            advance_consumer();
+        }
+        cached_tail_ = seg_->tail_.load(std::memory_order_acquire);
+        head_ = std::min(offset, cached_tail_);
+        return position() == index;
+    }
+
+    // see PShmBBufferLockFree::set_streaming_stores()
+    void set_streaming_stores(bool enable) {
+        static_assert(IsProducer, "can only be called from producers");
+        streaming_stores_ = enable;
+    }
+
+    // see PShmBBufferLockFree::set_prefetch_distance()
+    void set_prefetch_distance(idx_t dist) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        prefetch_dist_ = dist;
+    }
+
+    // see PShmBBufferLockFree::set_release_chunk(), useful if segments are large
+    void set_release_chunk(size_t chunk_bytes) {
+        release_chunk_ = chunk_bytes / sizeof(T);
+        idx_t pos = IsProducer ? seg_->tail_.load(std::memory_order_relaxed) : head_;
+        next_release_ = release_chunk_ == 0 ? ~idx_t(0) : pos + release_chunk_;
+    }
+
+    // index of the segment currently mapped by this process
+    idx_t segment() const { return seg_->seg_no_; }
+
+    // oldest segment a joining consumer starts at
+    idx_t head_segment() const { return cb_->head_seg_.load(std::memory_order_relaxed); }
+
+    const std::string &shm_name() const { return shm_name_; }
+
+private:
+    std::string segment_name(idx_t seg_no) const {
+        return shm_name_ + "." + std::to_string(seg_no);
+    }
+
+    size_t segment_size() const { return sizeof(ShmSegmentHeader) + sizeof(T) * cb_->seg_cap_; }
+
+    bool create_segment(idx_t seg_no) {
+        std::string name = segment_name(seg_no);
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd == -1) {
+            perror("shm_open");
+            return false;
+        }
+        // the header and `has_next_` flag are initialized to zero by ftruncate
+        if (ftruncate(fd, segment_size()) == -1) {
+            perror("ftruncate");
+            close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        close(fd);
+        return true;
+    }
+
+    ShmSegmentHeader *map_segment(idx_t seg_no) {
+        std::string name = segment_name(seg_no);
+        int fd = shm_open(name.c_str(), IsProducer ? O_RDWR : O_RDONLY, 0600);
+        if (fd == -1) {
+            perror("shm_open");
+            return nullptr;
+        }
+        constexpr int flags = IsProducer ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void *p = mmap(nullptr, segment_size(), flags, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            perror("mmap");
+            return nullptr;
+        }
+
+        auto *seg = static_cast<ShmSegmentHeader *>(p);
+        if constexpr (IsProducer)
+            seg->seg_no_ = seg_no;
+        buffer_ = reinterpret_cast<T *>(&seg[1]);
+        releaser_.reset(buffer_);
+        if (release_chunk_ != 0)
+            next_release_ = release_chunk_;
+        return seg;
+    }
+
+    void release_behind(idx_t pos) {
+        releaser_.release_until(&buffer_[pos]);
+        next_release_ = pos + release_chunk_;
+    }
+
+    bool advance_producer() {
+        idx_t next_no = seg_->seg_no_ + 1;
+        if (!create_segment(next_no))
+            return false;
+        ShmSegmentHeader *next = map_segment(next_no);
+        if (next == nullptr) {
+            shm_unlink(segment_name(next_no).c_str());
+            return false;
+        }
+
+        // publish the link only after the new segment is fully initialized
+        cb_->tail_seg_.store(next_no, std::memory_order_relaxed);
+        seg_->has_next_.store(true, std::memory_order_release);
+        munmap(seg_, segment_size());
+        seg_ = next;
+
+        reclaim_segments();
+        return true;
+    }
+
+    // Unlinks the segments every registered consumer has passed.
+    //
+    // A joining consumer stores its slot and then re-reads `head_seg_`, while the producer
+    // stores `head_seg_` and then re-scans the slots (Dekker style, both seq_cst). So either the
+    // producer sees the new consumer's segment, or the consumer sees the advanced head and
+    // retries. The head is stored once and never moves back, so a joining consumer can't start
+    // past segments that are still retained. Segments a consumer that joined on the previous
+    // head still holds stay linked until it moves on, tracked by `reclaimed_seg_`.
+    void reclaim_segments() {
+        if (cb_->num_registered_.load(std::memory_order_acquire) < cb_->min_consumers_)
+            return;
+
+        idx_t head = cb_->head_seg_.load(std::memory_order_relaxed);
+        idx_t new_head = min_consumer_segment(seg_->seg_no_);
+        if (new_head > head) {
+            cb_->head_seg_.store(new_head, std::memory_order_seq_cst);
+            head = new_head;
+        }
+
+        idx_t begin = cb_->reclaimed_seg_.load(std::memory_order_relaxed);
+        idx_t end = min_consumer_segment(head);
+        for (idx_t n = begin; n < end; n++)
+            shm_unlink(segment_name(n).c_str());
+        if (end > begin)
+            cb_->reclaimed_seg_.store(end, std::memory_order_release);
+    }
+
+    // also true while the log is retained for `min_consumers` that haven't attached yet
+    bool any_consumer_attached() const {
+        if (cb_->num_registered_.load(std::memory_order_acquire) < cb_->min_consumers_)
+            return true;
+        for (const auto &slot : cb_->consumers_) {
+            if (slot.in_use_.load(std::memory_order_seq_cst))
+                return true;
+        }
+        return false;
+    }
+
+    // unlinks the segments not reclaimed yet and the control object
+    void unlink_log() {
+        idx_t tail = cb_->tail_seg_.load(std::memory_order_acquire);
+        for (idx_t n = cb_->reclaimed_seg_.load(std::memory_order_acquire); n <= tail; n++)
+            shm_unlink(segment_name(n).c_str());
+        shm_unlink(shm_name_.c_str());
+    }
+
+    idx_t min_consumer_segment(idx_t upper) const {
+        idx_t min_seg = upper;
+        for (const auto &slot : cb_->consumers_) {
+            if (!slot.in_use_.load(std::memory_order_seq_cst))
+                continue;
+            idx_t seg_no = slot.seg_no_.load(std::memory_order_seq_cst);
+            if (seg_no < min_seg)
+                min_seg = seg_no;
+        }
+        return min_seg;
+    }
+
+    void register_consumer() {
+        // a free slot's `seg_no_` was reset to kNoSegment before its `in_use_` was cleared
+        for (slot_ = 0; slot_ < MAX_SEGMENTED_LOG_CONSUMERS; slot_++) {
+            bool expected = false;
+            if (cb_->consumers_[slot_].in_use_.compare_exchange_strong(expected, true))
+                break;
+        }
+        if (slot_ == MAX_SEGMENTED_LOG_CONSUMERS) {
+            fprintf(stderr, "too many consumers on %s\n", shm_name_.c_str());
+            exit(EXIT_FAILURE);
+        }
+
+        SegmentedLogConsumerSlot &slot = cb_->consumers_[slot_];
+        idx_t seg_no = cb_->head_seg_.load(std::memory_order_seq_cst);
+        while (true) {
+            slot.seg_no_.store(seg_no, std::memory_order_seq_cst);
+            idx_t head = cb_->head_seg_.load(std::memory_order_seq_cst);
+            if (head <= seg_no)
+                break;
+            seg_no = head;
+        }
+
+        seg_ = map_segment(seg_no);
+        if (seg_ == nullptr)
+            exit(EXIT_FAILURE);
+        cb_->num_registered_.fetch_add(1, std::memory_order_release);
+    }
+
+    void advance_consumer() {
+        ShmSegmentHeader *next = map_segment(seg_->seg_no_ + 1);
+        if (next == nullptr)
+            exit(EXIT_FAILURE);
+        munmap(seg_, segment_size());
+        seg_ = next;
+        head_ = 0;
+        cached_tail_ = 0;
+        // let the producer reclaim the segment we just left
+        cb_->consumers_[slot_].seg_no_.store(seg_->seg_no_, std::memory_order_seq_cst);
+    }
+
+    const std::string shm_name_;
+
+    ShmControlBlockSegmented *cb_;
+    ShmSegmentHeader *seg_ = nullptr;
+    T *buffer_;
+    int slot_ = -1;
+    idx_t head_ = 0;
+    idx_t cached_tail_ = 0;
+    idx_t prefetch_dist_ = 0;
+    bool streaming_stores_ = false;
+    idx_t release_chunk_ = 0;
+    idx_t next_release_ = ~idx_t(0);
+    MappedRegionReleaser releaser_;
+};
+
+}  // namespace shm_spmc
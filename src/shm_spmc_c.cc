@@ -0,0 +1,137 @@
+// libshm_spmc.so, see shm_spmc_c.h
+#include "shm_spmc_c.h"
+#include "shm_bbuffer_spmc.h"
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <utility>
+
+static_assert(SHM_SPMC_SUCCESS == CONSUME_SUCCESS && SHM_SPMC_AGAIN == CONSUME_AGAIN &&
+              SHM_SPMC_FINISHED == CONSUME_FINISHED);
+static_assert(sizeof(uint64_t) == sizeof(shm_spmc::idx_t));
+
+// the record type isn't known at compile time, so the consumer is instantiated for every
+// supported size and called through this interface
+struct shm_spmc_consumer {
+    virtual ~shm_spmc_consumer() = default;
+    virtual int peek(const void *&items, shm_spmc::idx_t &n, shm_spmc::idx_t max_n) = 0;
+    virtual bool advance(shm_spmc::idx_t n) = 0;
+    virtual void seek(shm_spmc::idx_t index) = 0;
+    virtual shm_spmc::idx_t position() const = 0;
+    virtual shm_spmc::idx_t size() const = 0;
+    virtual shm_spmc::idx_t capacity() const = 0;
+};
+
+namespace {
+
+template <size_t Size>
+struct RawItem {
+    unsigned char bytes[Size];
+};
+
+template <size_t Size>
+class RawConsumer final : public shm_spmc_consumer {
+public:
+    explicit RawConsumer(const char *shm_name) : ring_(shm_name) {}
+
+    int peek(const void *&items, shm_spmc::idx_t &n, shm_spmc::idx_t max_n) override {
+        const RawItem<Size> *first = nullptr;
+        int rc = ring_.peek(first, n, max_n);
+        items = first;
+        peeked_ = rc == CONSUME_SUCCESS ? n : 0;
+        return rc;
+    }
+
+    // PShmBBufferLockFree::advance() only asserts, a caller from another language could move
+    // the head past the published items
+    bool advance(shm_spmc::idx_t n) override {
+        if (n > peeked_)
+            return false;
+        ring_.advance(n);
+        peeked_ -= n;
+        return true;
+    }
+
+    void seek(shm_spmc::idx_t index) override {
+        ring_.seek(index);
+        peeked_ = 0;
+    }
+
+    shm_spmc::idx_t position() const override { return ring_.position(); }
+    shm_spmc::idx_t size() const override { return ring_.size(); }
+    shm_spmc::idx_t capacity() const override { return ring_.capacity(); }
+
+private:
+    shm_spmc::PShmBBufferLockFree<RawItem<Size>, /* IsProducer = */ false> ring_;
+    shm_spmc::idx_t peeked_ = 0;  // # of items the last peek() returned, not advanced past yet
+};
+
+template <size_t... I>
+shm_spmc_consumer *make_consumer(const char *shm_name, size_t item_size,
+                                 std::index_sequence<I...>) {
+    shm_spmc_consumer *consumer = nullptr;
+    ((item_size == (I + 1) * 4 && (consumer = new RawConsumer<(I + 1) * 4>(shm_name))) || ...);
+    return consumer;
+}
+
+// checks the buffer is there and holds items of `item_size`, as PShmBBufferLockFree would call
+// handle_error() and exit the caller's process instead
+bool check_shm(const char *shm_name, size_t item_size) {
+    int shm_fd = shm_open(shm_name, O_RDONLY, 0600);
+    if (shm_fd == -1)
+        return false;
+    struct stat st;
+    shm_spmc::idx_t capacity;
+    bool ok = fstat(shm_fd, &st) == 0 &&
+              pread(shm_fd, &capacity, sizeof capacity, 0) == sizeof capacity &&
+              (size_t)st.st_size == sizeof(shm_spmc::ShmControlBlockLockFree) + capacity * item_size;
+    close(shm_fd);
+    if (!ok)
+        errno = EINVAL;
+    return ok;
+}
+
+}  // namespace
+
+extern "C" {
+
+int shm_spmc_abi_version(void) { return SHM_SPMC_ABI_VERSION; }
+
+shm_spmc_consumer *shm_spmc_attach(const char *shm_name, size_t item_size) {
+    if (item_size == 0 || item_size % 4 != 0 || item_size > SHM_SPMC_MAX_ITEM_SIZE) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    if (!check_shm(shm_name, item_size))
+        return nullptr;
+    return make_consumer(shm_name, item_size,
+                         std::make_index_sequence<SHM_SPMC_MAX_ITEM_SIZE / 4>());
+}
+
+void shm_spmc_detach(shm_spmc_consumer *consumer) { delete consumer; }
+
+int shm_spmc_peek(shm_spmc_consumer *consumer, const void **items, uint64_t *n, uint64_t max_n) {
+    shm_spmc::idx_t count = 0;
+    int rc = consumer->peek(*items, count, max_n);
+    *n = rc == CONSUME_SUCCESS ? count : 0;
+    return rc;
+}
+
+int shm_spmc_advance(shm_spmc_consumer *consumer, uint64_t n) {
+    if (!consumer->advance(n)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+void shm_spmc_seek(shm_spmc_consumer *consumer, uint64_t index) { consumer->seek(index); }
+
+uint64_t shm_spmc_position(const shm_spmc_consumer *consumer) { return consumer->position(); }
+
+uint64_t shm_spmc_size(const shm_spmc_consumer *consumer) { return consumer->size(); }
+
+uint64_t shm_spmc_capacity(const shm_spmc_consumer *consumer) { return consumer->capacity(); }
+
+}  // extern "C"
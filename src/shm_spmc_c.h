@@ -0,0 +1,71 @@
+/*
+ * C ABI of libshm_spmc.so, for reading PShmBBufferLockFree buffers from other languages, e.g.
+ * Python via ctypes (see shm_spmc.py). Items are opaque records of `item_size` bytes, the
+ * caller lays them out, e.g. as a numpy structured dtype matching the producer's struct.
+ */
+#ifndef SHM_SPMC_C_H
+#define SHM_SPMC_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped on any incompatible change of the functions below */
+#define SHM_SPMC_ABI_VERSION 2
+
+/* return codes of shm_spmc_peek(), same as CONSUME_* in shm_bbuffer_spmc.h */
+#define SHM_SPMC_SUCCESS 1
+#define SHM_SPMC_AGAIN 0
+#define SHM_SPMC_FINISHED -1
+
+/* item sizes supported by shm_spmc_attach(): multiples of 4 up to this */
+#define SHM_SPMC_MAX_ITEM_SIZE 256
+
+typedef struct shm_spmc_consumer shm_spmc_consumer;
+
+int shm_spmc_abi_version(void);
+
+/*
+ * Attaches a consumer, starting at index 0, to the buffer `shm_name` written by a
+ * PShmBBufferLockFree<T> producer with sizeof(T) == `item_size`.
+ * returns NULL and sets errno if the buffer doesn't exist (ENOENT) or its size doesn't match
+ * `item_size` (EINVAL)
+ */
+shm_spmc_consumer *shm_spmc_attach(const char *shm_name, size_t item_size);
+
+/* unmaps the buffer, items returned by shm_spmc_peek() are no longer valid */
+void shm_spmc_detach(shm_spmc_consumer *consumer);
+
+/*
+ * Gets up to `max_n` published items at the consumer's head in place: `*items` points at the
+ * first one and `*n` is set to their #. They stay valid until shm_spmc_advance() moves past
+ * them. returns SHM_SPMC_SUCCESS, SHM_SPMC_AGAIN or SHM_SPMC_FINISHED
+ */
+int shm_spmc_peek(shm_spmc_consumer *consumer, const void **items, uint64_t *n, uint64_t max_n);
+
+/*
+ * moves the head past `n` items returned by shm_spmc_peek()
+ * returns 0, or -1 and sets errno to EINVAL without moving the head if `n` is more than the
+ * items the last shm_spmc_peek() returned that haven't been advanced past yet
+ */
+int shm_spmc_advance(shm_spmc_consumer *consumer, uint64_t n);
+
+/* moves the head to `index`, clamped to the published items */
+void shm_spmc_seek(shm_spmc_consumer *consumer, uint64_t index);
+
+/* index of the consumer's next item */
+uint64_t shm_spmc_position(const shm_spmc_consumer *consumer);
+
+/* # of items published so far */
+uint64_t shm_spmc_size(const shm_spmc_consumer *consumer);
+
+uint64_t shm_spmc_capacity(const shm_spmc_consumer *consumer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHM_SPMC_C_H */
@@ -0,0 +1,255 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace shm_spmc {
+
+struct ShmControlBlockSymIndexed {
+    idx_t cap_;
+    idx_t max_syms_;
+    std::atomic<idx_t> tail_;
+    CACHELINE_ALIGNED std::atomic<bool> writer_finished_;
+};
+
+// Lock-free append-only log (like PShmBBufferLockFree) that also chains the records of each
+// symbol: `first_[s]` is the index of the first record of symbol `s`, `next_[i]` the index of
+// the next record with the same symbol as record `i`, both stored as index + 1 (0 = none yet).
+//
+// A consumer that subscribes to a few symbols follows their chains and only touches matching
+// records, instead of reading and discarding the whole feed. The producer writes the links
+// before it publishes the new tail with release semantics, so a consumer that has acquired
+// tail `t` sees every link to a record below `t`, the same visibility guarantee as consume().
+//
+// `T` needs an unsigned `sym_id` member below `max_syms`.
+template <typename T, bool IsProducer>
+class PShmBBufferSymIndexed {
+public:
+    explicit PShmBBufferSymIndexed(const char *shm_name, idx_t capacity = 0,
+                                   idx_t max_syms = 1 << 16)
+        : shm_name_(shm_name) {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+        if constexpr (IsProducer) {
+            shm_fd_ = create_shm_object(shm_name);
+        } else {
+            shm_fd_ = shm_open(shm_name, O_RDONLY, 0600);
+        }
+        if (shm_fd_ == -1)
+            handle_error("shm_open");
+
+        if constexpr (IsProducer) {
+            // all links are initialized to zero (none) by ftruncate
+            if (ftruncate(shm_fd_, get_shm_size(capacity, max_syms)) == -1)
+                handle_error("ftruncate");
+        } else {
+            // consumer can read the capacity and # of symbols from the shared memory
+            idx_t meta[2];
+            ssize_t nbytes = read(shm_fd_, meta, sizeof meta);
+            assert(nbytes == sizeof meta);
+            capacity = meta[0];
+            max_syms = meta[1];
+        }
+
+        constexpr int flags = IsProducer ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void *shmp =
+            mmap(nullptr, get_shm_size(capacity, max_syms), flags, MAP_SHARED, shm_fd_, 0);
+        if (shmp == MAP_FAILED)
+            handle_error("mmap");
+
+        cb_ = static_cast<ShmControlBlockSymIndexed *>(shmp);
+        if constexpr (IsProducer) {
+            cb_->cap_ = capacity;
+            cb_->max_syms_ = max_syms;
+            cb_->tail_.store(0, std::memory_order_relaxed);
+            cb_->writer_finished_.store(false, std::memory_order_relaxed);
+            last_.assign(max_syms, 0);
+            publish_shm_object(shm_name);
+        } else {
+            close(shm_fd_);
+        }
+        first_ = reinterpret_cast<std::atomic<idx_t> *>(&cb_[1]);
+        next_ = first_ + max_syms;
+        buffer_ = reinterpret_cast<T *>(next_ + capacity);
+    }
+
+    ~PShmBBufferSymIndexed() {
+        size_t shm_size = get_shm_size(cb_->cap_, cb_->max_syms_);
+        if constexpr (IsProducer) {
+            close(shm_fd_);
+            cb_->writer_finished_.store(true, std::memory_order_release);
+            // shm_unlink(shm_name_.c_str());
+        }
+        munmap(cb_, shm_size);
+    }
+
+    // producer appends an item to the buffer tail and links it into its symbol's chain
+    // returns false if the buffer is full
+    bool produce(const T &item) {
+        static_assert(IsProducer, "can only be called from producers");
+
+        idx_t tail = cb_->tail_.load(std::memory_order_relaxed);
+        if (tail == cb_->cap_)
+            return false;
+
+        copy_and_link(tail, &item, 1);
+        // publishes the item and its link
+        cb_->tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer appends up to `n` items to the buffer tail and publishes them at once
+    // returns the # of items appended, which is less than `n` if the buffer gets full
+    idx_t produce_bulk(const T *items, idx_t n) {
+        static_assert(IsProducer, "can only be called from producers");
+
+        idx_t tail = cb_->tail_.load(std::memory_order_relaxed);
+        if (n > cb_->cap_ - tail)
+            n = cb_->cap_ - tail;
+
+        copy_and_link(tail, items, n);
+        cb_->tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Restricts consume() to the records of `sym_ids`, delivered in log order. Has to be
+    // called before the first consume().
+    void subscribe(const std::vector<uint32_t> &sym_ids) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        assert(head_ == 0 && !filtered_);
+
+        filtered_ = true;
+        for (uint32_t sym_id : sym_ids) {
+            assert(sym_id < cb_->max_syms_);
+            subs_.push_back({sym_id, 0});
+            waiting_.push_back(subs_.size() - 1);
+        }
+    }
+
+    // consumer retrieves an item from the buffer head, or the next item of its subscribed
+    // symbols after subscribe()
+    int consume(T &item) {
+        static_assert(!IsProducer, "can only be called from consumers");
+        if (filtered_)
+            return consume_filtered(item);
+
+        if (head_ == cached_tail_) {
+            bool finished = cb_->writer_finished_.load(std::memory_order_acquire);
+            cached_tail_ = cb_->tail_.load(std::memory_order_acquire);
+            if (head_ == cached_tail_)
+                return finished ? CONSUME_FINISHED : CONSUME_AGAIN;
+        }
+
+        memcpy(&item, &buffer_[head_], sizeof item);
+        head_++;
+        return CONSUME_SUCCESS;
+    }
+
+    idx_t capacity() const { return cb_->cap_; }
+    idx_t max_syms() const { return cb_->max_syms_; }
+
+    // see PShmBBufferLockFree::set_streaming_stores()
+    void set_streaming_stores(bool enable) {
+        static_assert(IsProducer, "can only be called from producers");
+        streaming_stores_ = enable;
+    }
+
+private:
+    struct Subscription {
+        uint32_t sym_id;
+        idx_t last;  // index + 1 of the last record delivered, 0 if none
+    };
+
+    // (index of the next record, subscription)
+    typedef std::pair<idx_t, size_t> Pending;
+
+    void copy_and_link(idx_t tail, const T *items, idx_t n) {
+        if (streaming_stores_) {
+            stream_copy(&buffer_[tail], items, sizeof *items * n);
+            store_fence();
+        } else {
+            memcpy(&buffer_[tail], items, sizeof *items * n);
+        }
+        for (idx_t i = 0; i < n; i++) {
+            uint32_t sym_id = items[i].sym_id;
+            assert(sym_id < cb_->max_syms_);
+            idx_t &last = last_[sym_id];
+            if (last == 0)
+                first_[sym_id].store(tail + i + 1, std::memory_order_relaxed);
+            else
+                next_[last - 1].store(tail + i + 1, std::memory_order_relaxed);
+            last = tail + i + 1;
+        }
+    }
+
+    int consume_filtered(T &item) {
+        if (ready_.empty() || ready_.top().first >= cached_tail_) {
+            // load `writer_finished_` before `tail_` so no item published before it is missed
+            bool finished = cb_->writer_finished_.load(std::memory_order_acquire);
+            cached_tail_ = cb_->tail_.load(std::memory_order_acquire);
+            resolve_waiting();
+            // the waiting subscriptions have no record below the tail
+            if (ready_.empty() || ready_.top().first >= cached_tail_)
+                return finished ? CONSUME_FINISHED : CONSUME_AGAIN;
+        }
+
+        // every waiting subscription's next record is at or beyond `cached_tail_`, so
+        // delivering the smallest ready index below it keeps the log order
+        auto [idx, sub] = ready_.top();
+        ready_.pop();
+        memcpy(&item, &buffer_[idx], sizeof item);
+        subs_[sub].last = idx + 1;
+        idx_t next = next_[idx].load(std::memory_order_relaxed);
+        if (next != 0 && next - 1 < cached_tail_)
+            ready_.push({next - 1, sub});
+        else
+            waiting_.push_back(sub);
+        return CONSUME_SUCCESS;
+    }
+
+    // looks up the next record of the subscriptions that had none below the old tail
+    void resolve_waiting() {
+        for (size_t i = 0; i < waiting_.size();) {
+            const Subscription &s = subs_[waiting_[i]];
+            idx_t next = s.last == 0 ? first_[s.sym_id].load(std::memory_order_relaxed)
+                                     : next_[s.last - 1].load(std::memory_order_relaxed);
+            if (next != 0 && next - 1 < cached_tail_) {
+                ready_.push({next - 1, waiting_[i]});
+                waiting_[i] = waiting_.back();
+                waiting_.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+
+    static size_t get_shm_size(idx_t cap, idx_t max_syms) {
+        return sizeof(ShmControlBlockSymIndexed) + sizeof(idx_t) * (max_syms + cap) +
+               sizeof(T) * cap;
+    }
+
+    const std::string shm_name_;
+    int shm_fd_;
+
+    ShmControlBlockSymIndexed *cb_;
+    std::atomic<idx_t> *first_;
+    std::atomic<idx_t> *next_;
+    T *buffer_;
+    idx_t head_ = 0;
+    idx_t cached_tail_ = 0;
+
+    // producer only
+    std::vector<idx_t> last_;
+    bool streaming_stores_ = false;
+
+    // filtered consumers only
+    bool filtered_ = false;
+    std::vector<Subscription> subs_;
+    std::vector<size_t> waiting_;
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>> ready_;
+};
+
+}  // namespace shm_spmc
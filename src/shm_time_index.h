@@ -0,0 +1,121 @@
+#pragma once
+
+#include "shm_bbuffer_spmc.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace shm_spmc {
+
+struct TimeIndexEntry {
+    int64_t time;
+    idx_t index;  // first record in the log with this time
+};
+
+struct ShmControlBlockTimeIndex {
+    idx_t cap_;
+    idx_t stride_;
+    std::atomic<idx_t> len_;
+};
+
+// Sparse time -> log index side table for an append-only log whose record times never
+// decrease, e.g. the one written by `producer`.
+//
+// The producer reports every record it has published; an entry is appended at the first record
+// of a new time, if at least `stride` records have passed since the previous entry. So every
+// entry marks a time boundary, and a consumer attaching mid-session can binary search the table
+// and start reading close to the time it wants instead of at index 0.
+template <bool IsProducer>
+class PShmTimeIndex {
+public:
+    // `capacity` is the max # of entries, `stride` the min # of records between two entries
+    explicit PShmTimeIndex(const char *shm_name, idx_t capacity = 0, idx_t stride = 1)
+        : shm_name_(shm_name) {
+        int shm_fd = -1;
+        if constexpr (IsProducer) {
+            shm_fd = create_shm_object(shm_name);
+        } else {
+            shm_fd = shm_open(shm_name, O_RDONLY, 0600);
+        }
+        if (shm_fd == -1)
+            handle_error("shm_open");
+
+        if constexpr (IsProducer) {
+            if (ftruncate(shm_fd, get_shm_size(capacity)) == -1)
+                handle_error("ftruncate");
+        } else {
+            // consumer can read the capacity from the shared memory
+            ssize_t nbytes = read(shm_fd, &capacity, sizeof capacity);
+            assert(nbytes == sizeof capacity);
+        }
+
+        constexpr int flags = IsProducer ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void *shmp = mmap(nullptr, get_shm_size(capacity), flags, MAP_SHARED, shm_fd, 0);
+        if (shmp == MAP_FAILED)
+            handle_error("mmap");
+        close(shm_fd);
+
+        cb_ = static_cast<ShmControlBlockTimeIndex *>(shmp);
+        if constexpr (IsProducer) {
+            cb_->cap_ = capacity;
+            cb_->stride_ = stride;
+            cb_->len_.store(0, std::memory_order_relaxed);
+            publish_shm_object(shm_name);
+        }
+        entries_ = reinterpret_cast<TimeIndexEntry *>(&cb_[1]);
+    }
+
+    ~PShmTimeIndex() {
+        munmap(cb_, get_shm_size(cb_->cap_));
+        // shm_unlink(shm_name_.c_str());
+    }
+
+    // producer reports the record at `index` with `time`, after publishing it in the log
+    // returns false if the table is full
+    bool on_record(int64_t time, idx_t index) {
+        static_assert(IsProducer, "can only be called from producers");
+        if (likely(time == last_time_))
+            return true;
+        assert(time > last_time_);
+        last_time_ = time;
+
+        idx_t len = cb_->len_.load(std::memory_order_relaxed);
+        if (len != 0 && index - entries_[len - 1].index < cb_->stride_)
+            return true;
+        if (len == cb_->cap_)
+            return false;
+        entries_[len] = {time, index};
+        cb_->len_.store(len + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns the index of the first record of the latest indexed time <= `time`, 0 if there
+    // is none. Every record before it is older than `time`; records from it up to the first
+    // one with `time` are older as well if `time` itself is not indexed, so skip those.
+    idx_t seek(int64_t time) const {
+        static_assert(!IsProducer, "can only be called from consumers");
+        idx_t len = cb_->len_.load(std::memory_order_acquire);
+        const TimeIndexEntry *it =
+            std::upper_bound(entries_, entries_ + len, time,
+                             [](int64_t t, const TimeIndexEntry &e) { return t < e.time; });
+        return it == entries_ ? 0 : it[-1].index;
+    }
+
+    idx_t size() const { return cb_->len_.load(std::memory_order_acquire); }
+    idx_t capacity() const { return cb_->cap_; }
+
+    const std::string &shm_name() const { return shm_name_; }
+
+private:
+    static size_t get_shm_size(idx_t cap) {
+        return sizeof(ShmControlBlockTimeIndex) + sizeof(TimeIndexEntry) * cap;
+    }
+
+    const std::string shm_name_;
+
+    ShmControlBlockTimeIndex *cb_;
+    TimeIndexEntry *entries_;
+    int64_t last_time_ = INT64_MIN;  // producer only
+};
+
+}  // namespace shm_spmc
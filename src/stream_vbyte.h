@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <tmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Stream VByte: variable-byte integer encoding with SIMD-friendly decoding.
+// see Lemire et al., "Stream VByte: Faster Byte-Oriented Integer Compression" (2017)
+//
+// The 1-4 byte lengths of every 4 integers are packed into one control byte, and all control
+// bytes are stored before the data bytes. A decoder can then look up the shuffle that spreads
+// the next (up to) 16 data bytes into 4 integers with a single `pshufb`/`tbl`, instead of
+// testing a continuation bit per byte.
+namespace shm_spmc {
+
+inline uint32_t zigzag_encode(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+
+inline int32_t zigzag_decode(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+inline size_t svb_max_encoded_size(size_t n) { return (n + 3) / 4 + n * 4; }
+
+// # of data bytes `v` takes, 1-4
+inline int svb_value_size(uint32_t v) { return (39 - __builtin_clz(v | 1)) >> 3; }
+
+// returns the # of bytes written to `out`, at most svb_max_encoded_size(n)
+inline size_t svb_encode(const uint32_t *in, size_t n, uint8_t *out) {
+    uint8_t *ctrl = out;
+    uint8_t *data = out + (n + 3) / 4;
+    for (size_t i = 0; i < n; i += 4) {
+        uint8_t c = 0;
+        for (size_t j = 0; j < 4 && i + j < n; j++) {
+            uint32_t v = in[i + j];
+            int len = svb_value_size(v);
+            memcpy(data, &v, sizeof v);  // little-endian, the extra bytes get overwritten
+            data += len;
+            c |= (len - 1) << (j * 2);
+        }
+        *ctrl++ = c;
+    }
+    return data - out;
+}
+
+namespace detail {
+
+struct SvbTables {
+    uint8_t len[256];
+    uint8_t shuffle[256][16];
+
+    constexpr SvbTables() : len(), shuffle() {
+        for (int c = 0; c < 256; c++) {
+            int pos = 0;
+            for (int j = 0; j < 4; j++) {
+                int l = ((c >> (j * 2)) & 3) + 1;
+                for (int k = 0; k < 4; k++)
+                    shuffle[c][j * 4 + k] = k < l ? pos + k : 0x80;  // 0x80: zero the byte
+                pos += l;
+            }
+            len[c] = pos;
+        }
+    }
+};
+
+inline constexpr SvbTables svb_tables{};
+
+// decodes the integers [i, n) one by one, returns the new data pointer
+template <bool Delta>
+inline const uint8_t *svb_decode_scalar(const uint8_t *ctrl, const uint8_t *data, size_t i,
+                                        size_t n, const uint32_t *ref, uint32_t *out) {
+    for (; i < n; i++) {
+        int len = ((ctrl[i / 4] >> (i % 4 * 2)) & 3) + 1;
+        uint32_t v = 0;
+        memcpy(&v, data, len);
+        out[i] = Delta ? ref[i] + zigzag_decode(v) : v;
+        data += len;
+    }
+    return data;
+}
+
+// decodes 4 integers at a time while a 16-byte load doesn't run past `end`, and sets `i` to
+// the # decoded, returns the new data pointer
+#if defined(__x86_64__)
+template <bool Delta>
+__attribute__((target("ssse3"))) inline const uint8_t *svb_decode_simd(
+    const uint8_t *ctrl, const uint8_t *data, const uint8_t *end, size_t n,
+    const uint32_t *ref, uint32_t *out, size_t &i) {
+    const __m128i one = _mm_set1_epi32(1);
+    for (i = 0; i + 4 <= n && data + 16 <= end; i += 4) {
+        uint8_t c = ctrl[i / 4];
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(svb_tables.shuffle[c]));
+        __m128i v = _mm_shuffle_epi8(in, mask);
+        if constexpr (Delta) {
+            // ref + ((v >> 1) ^ -(v & 1))
+            __m128i neg = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, one));
+            v = _mm_xor_si128(_mm_srli_epi32(v, 1), neg);
+            v = _mm_add_epi32(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(&ref[i])));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out[i]), v);
+        data += svb_tables.len[c];
+    }
+    return data;
+}
+#elif defined(__aarch64__)
+template <bool Delta>
+inline const uint8_t *svb_decode_simd(const uint8_t *ctrl, const uint8_t *data,
+                                      const uint8_t *end, size_t n, const uint32_t *ref,
+                                      uint32_t *out, size_t &i) {
+    const uint32x4_t one = vdupq_n_u32(1);
+    for (i = 0; i + 4 <= n && data + 16 <= end; i += 4) {
+        uint8_t c = ctrl[i / 4];
+        uint8x16_t mask = vld1q_u8(svb_tables.shuffle[c]);
+        // out-of-range indices (0x80) make `tbl` produce zero bytes, like `pshufb`
+        uint32x4_t v = vreinterpretq_u32_u8(vqtbl1q_u8(vld1q_u8(data), mask));
+        if constexpr (Delta) {
+            int32x4_t neg = vnegq_s32(vreinterpretq_s32_u32(vandq_u32(v, one)));
+            v = veorq_u32(vshrq_n_u32(v, 1), vreinterpretq_u32_s32(neg));
+            v = vaddq_u32(v, vld1q_u32(&ref[i]));
+        }
+        vst1q_u32(&out[i], v);
+        data += svb_tables.len[c];
+    }
+    return data;
+}
+#endif
+
+template <bool Delta>
+inline size_t svb_decode(const uint8_t *in, size_t in_size, size_t n, const uint32_t *ref,
+                         uint32_t *out) {
+    const uint8_t *ctrl = in;
+    const uint8_t *data = in + (n + 3) / 4;
+    size_t i = 0;
+#if defined(__x86_64__)
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    if (has_ssse3)
+        data = svb_decode_simd<Delta>(ctrl, data, in + in_size, n, ref, out, i);
+#elif defined(__aarch64__)
+    data = svb_decode_simd<Delta>(ctrl, data, in + in_size, n, ref, out, i);
+#endif
+    data = svb_decode_scalar<Delta>(ctrl, data, i, n, ref, out);
+    return data - in;
+}
+
+}  // namespace detail
+
+// Decodes `n` integers encoded by svb_encode() from `in`, whose encoded size is `in_size`.
+// returns the # of bytes consumed
+inline size_t svb_decode(const uint8_t *in, size_t in_size, size_t n, uint32_t *out) {
+    return detail::svb_decode<false>(in, in_size, n, nullptr, out);
+}
+
+// Like svb_decode(), for zigzag mapped deltas: `out[i] = ref[i] + zigzag_decode(value i)`,
+// which the SIMD path does in the same pass.
+inline size_t svb_decode_delta(const uint8_t *in, size_t in_size, size_t n, const uint32_t *ref,
+                               uint32_t *out) {
+    return detail::svb_decode<true>(in, in_size, n, ref, out);
+}
+
+// Reference decoder without SIMD, e.g. for comparing against svb_decode().
+inline size_t svb_decode_scalar(const uint8_t *in, size_t n, uint32_t *out) {
+    const uint8_t *data =
+        detail::svb_decode_scalar<false>(in, in + (n + 3) / 4, 0, n, nullptr, out);
+    return data - in;
+}
+
+}  // namespace shm_spmc